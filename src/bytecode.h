@@ -0,0 +1,127 @@
+#pragma once
+
+#include "object_holder.h"
+#include "object.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+class TestRunner;
+
+namespace Bytecode {
+
+// Operands are register numbers unless said otherwise:
+//   LoadConst dst, constant            LoadNone dst                 LoadBool dst, value
+//   Move dst, src                      CheckSet reg, name, last     GetField dst, object, field site
+//   CheckInstance object, field site   SetField object, value, field site
+//   Add/Sub/Mult/Div dst, lhs, rhs     Less/Greater/Equal/NotEqual/LessOrEqual/GreaterOrEqual dst, lhs, rhs
+//   Not/Negate dst, src                Str dst, src
+//   Call dst, object, call site        TailCall object, call site   New dst, new site
+//   PrintSpace                         Print src                    PrintNewline
+//   Jump target                        JumpIfFalse/JumpIfTrue src, target
+//   Return src                         ReturnNone
+#define SITHON_OPCODES(X) \
+    X(LoadConst)          \
+    X(LoadNone)           \
+    X(LoadBool)           \
+    X(Move)               \
+    X(CheckSet)           \
+    X(GetField)           \
+    X(CheckInstance)      \
+    X(SetField)           \
+    X(Add)                \
+    X(Sub)                \
+    X(Mult)               \
+    X(Div)                \
+    X(Less)               \
+    X(Greater)            \
+    X(Equal)              \
+    X(NotEqual)           \
+    X(LessOrEqual)        \
+    X(GreaterOrEqual)     \
+    X(Not)                \
+    X(Negate)             \
+    X(Str)                \
+    X(Call)               \
+    X(TailCall)           \
+    X(New)                \
+    X(PrintSpace)         \
+    X(Print)              \
+    X(PrintNewline)       \
+    X(Jump)               \
+    X(JumpIfFalse)        \
+    X(JumpIfTrue)         \
+    X(Return)             \
+    X(ReturnNone)
+
+enum class OpCode : uint8_t {
+#define SITHON_OPCODE_ENUM(name) name,
+    SITHON_OPCODES(SITHON_OPCODE_ENUM)
+#undef SITHON_OPCODE_ENUM
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t a = 0, b = 0, c = 0;
+};
+
+struct FieldSite {
+    Symbol field;
+    // Name of the object the field is read from, and whether the field is the last name
+    // of the dotted expression, for the same error messages the tree walker gives
+    Symbol object_name;
+    bool last;
+    Runtime::FieldCache cache;
+};
+
+// Arguments of a call are in consecutive registers starting from args
+struct CallSite {
+    Symbol method;
+    uint32_t args;
+    uint32_t argument_count;
+    Runtime::MethodCache cache;
+};
+
+struct NewSite {
+    const Runtime::Class *cls;
+    uint32_t args;
+    uint32_t argument_count;
+};
+
+// Compiled method body or top-level program. Registers start with the local
+// variables, numbered as the resolver numbered them, and the temporaries follow.
+struct Function {
+    std::vector<Instruction> code;
+    std::vector<ObjectHolder> constants;
+    std::vector<Symbol> names;
+    std::vector<FieldSite> field_sites;
+    std::vector<CallSite> call_sites;
+    std::vector<NewSite> new_sites;
+    size_t register_count = 0;
+};
+
+// Compiles the top-level program and attaches compiled code to the methods of every class
+// it defines. The tree must outlive the code: constants and classes are borrowed from it.
+std::unique_ptr<Function> CompileProgram(Ast::Statement &program);
+
+// Memory for the frames of the methods the VM runs, by default kDefaultStackLimit.
+// Recursion that needs more fails with an error.
+void SetStackLimit(size_t bytes);
+
+constexpr size_t kDefaultStackLimit = size_t(256) << 20;
+
+void Run(Function &program);
+
+// Whether the VM is running a program. Only then does the runtime call the compiled code of
+// methods, the tree walker runs their bodies even if the program has been compiled.
+bool IsRunning();
+
+// Runs a compiled method, the arguments are copied to the new frame
+ObjectHolder Invoke(Function &method, Runtime::ClassInstance &self, const ObjectHolder *args, size_t argument_count);
+
+void RunBytecodeTests(TestRunner &tr);
+
+}
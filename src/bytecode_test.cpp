@@ -0,0 +1,461 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner.h"
+
+#include <sstream>
+#include <string>
+
+
+using namespace std;
+
+namespace Bytecode {
+
+namespace {
+
+// Output of the program, followed by the error message if it fails
+string RunProgram(const string &program, bool compile) {
+    ostringstream output;
+    Ast::Print::SetOutputStream(output);
+
+    istringstream input(program);
+    Parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+    try {
+        if (compile) {
+            auto code = CompileProgram(*tree);
+            Run(*code);
+        } else {
+            Runtime::Closure closure;
+            tree->Execute(closure);
+        }
+    } catch (const runtime_error &e) {
+        output << "error: " << e.what();
+    }
+    return output.str();
+}
+
+}
+
+#define ASSERT_SAME_OUTPUT(program, expected)                  \
+do {                                                           \
+    ASSERT_EQUAL(RunProgram(program, true), expected);         \
+    ASSERT_EQUAL(RunProgram(program, false), expected);        \
+} while (false)
+
+void TestExpressions() {
+    ASSERT_SAME_OUTPUT(R"(
+x = 3
+y = x * 4 - -2
+print x, y, y / x, str(y) + 'z', not x, x < y, x == 3 and y > 100, x == 3 or y / 0
+print 'a' + 'b', None, True and x, 'q' == 'q', -x
+)", "3 14 4 14z False True False True\nab None True True -3\n");
+}
+
+void TestComparisons() {
+    ASSERT_SAME_OUTPUT(R"(
+print 1 < 2, 2 > 1, 1 == 1, 1 != 1, 2 <= 2, 1 >= 2
+print 'a' < 'b', 'a' > 'b', 'a' == 'a', 'a' != 'b', 'b' <= 'a', 'b' >= 'b'
+print True < False, True == True, None == None
+)", "True True True False True False\nTrue False True True False True\nFalse True True\n");
+    ASSERT_SAME_OUTPUT("print 1 == 'a'", "error: Cannot compare objects for equality");
+    ASSERT_SAME_OUTPUT("print 'a' >= 1", "error: Cannot compare objects for less");
+}
+
+void TestMethods() {
+    ASSERT_SAME_OUTPUT(R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __add__(other):
+    return self.x * other.x + self.y * other.y
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+  def __lt__(other):
+    return self.x < other.x
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+f = Fib()
+p = Point(4, 6)
+print f.calc(15), Point(1, 2) + Point(3, 4), p, p.x, p == Point(4, 6), Point(1, 0) < p, p >= Point(5, 0)
+)", "610 11 (4, 6) 4 True True False\n");
+}
+
+void TestRichComparisons() {
+    // Every operator is answered by one call of the most specific method the class defines
+    ASSERT_SAME_OUTPUT(R"(
+class Rich:
+  def __init__(value):
+    self.value = value
+
+  def __lt__(other):
+    print 'lt'
+    return self.value < other.value
+
+  def __eq__(other):
+    print 'eq'
+    return self.value == other.value
+
+  def __gt__(other):
+    print 'gt'
+    return self.value > other.value
+
+  def __ne__(other):
+    print 'ne'
+    return self.value != other.value
+
+class Ordered:
+  def __init__(value):
+    self.value = value
+
+  def __cmp__(other):
+    print 'cmp'
+    return self.value - other.value
+
+class Derived:
+  def __init__(value):
+    self.value = value
+
+  def __lt__(other):
+    print 'lt'
+    return self.value < other.value
+
+  def __eq__(other):
+    print 'eq'
+    return self.value == other.value
+
+a = Rich(2) > Rich(1)
+b = Rich(2) != Rich(2)
+c = Rich(1) <= Rich(2)
+print a, b, c
+a = Ordered(1) < Ordered(2)
+b = Ordered(2) >= Ordered(2)
+c = Ordered(1) == Ordered(2)
+print a, b, c
+a = Derived(2) > Derived(1)
+print a
+)", "gt\nne\ngt\nTrue False True\ncmp\ncmp\ncmp\nTrue True False\nlt\neq\nTrue\n");
+
+    ASSERT_SAME_OUTPUT(R"(
+class Both:
+  def __init__(value):
+    self.value = value
+
+  def __eq__(other):
+    print 'eq'
+    return self.value == other.value
+
+  def __cmp__(other):
+    print 'cmp'
+    return self.value - other.value
+
+a = Both(1) != Both(1)
+b = Both(1) == Both(2)
+c = Both(1) < Both(2)
+print a, b, c
+)", "eq\neq\ncmp\nFalse False True\n");
+
+    ASSERT_SAME_OUTPUT(R"(
+class Broken:
+  def __cmp__(other):
+    return 'less'
+
+print Broken() < Broken()
+)", "error: __cmp__ must return a number");
+}
+
+void TestEvaluationOrder() {
+    ASSERT_SAME_OUTPUT(R"(
+class Log:
+  def say(text):
+    print text
+    return text
+
+  def pair(a, b):
+    print a, b
+
+l = Log()
+print l.say('first'), l.say('second')
+l.pair(l.say('a'), l.say('b'))
+x = l.say(1) or l.say(2)
+x = l.say(0) and l.say(3)
+)", "first\nfirst second\nsecond\na\nb\na b\n1\n0\n");
+}
+
+void TestLoops() {
+    ASSERT_SAME_OUTPUT(R"(
+class Fib:
+  def calc(n):
+    a = 0
+    b = 1
+    while n > 0:
+      c = a + b
+      a = b
+      b = c
+      n = n - 1
+    return a
+
+  def before_loop(n):
+    while n > 0:
+      x = n
+      n = n - 1
+    return x
+
+f = Fib()
+i = 0
+while i < 100000:
+  i = i + 1
+print i, f.calc(30), f.before_loop(3)
+print f.before_loop(0)
+)", "100000 832040 1\nerror: Variable x not found in closure");
+}
+
+void TestTailCalls() {
+    // Far deeper than the native stack would allow for ordinary calls
+    ASSERT_SAME_OUTPUT(R"(
+class Counter:
+  def count(n, total):
+    if n == 0:
+      return total
+    return self.count(n - 1, total + 1)
+
+class Ping:
+  def ping(n, pong):
+    if n == 0:
+      return 'ping'
+    return pong.pong(n - 1, self)
+
+class Pong:
+  def pong(n, ping):
+    a = n
+    b = a
+    if n == 0:
+      return 'pong'
+    return ping.ping(b - 1, self)
+
+c = Counter()
+print c.count(100000, 0)
+p = Ping()
+print p.ping(20001, Pong()), p.ping(20000, Pong())
+)", "100000\npong ping\n");
+
+    ASSERT_SAME_OUTPUT(R"(
+class A:
+  def f(x):
+    return x.g()
+
+a = A()
+print a.f(1)
+)", "error: Trying to call method g on object whicj is not a class instance");
+}
+
+void TestDeepRecursion() {
+    const string program = R"(
+class Depth:
+  def measure(n):
+    if n == 0:
+      return 0
+    return 1 + self.measure(n - 1)
+
+d = Depth()
+print d.measure(100000)
+)";
+    // Only the VM can go this deep, the tree walker recurses natively
+    ASSERT_EQUAL(RunProgram(program, true), "100000\n");
+
+    SetStackLimit(64 << 10);
+    ASSERT_EQUAL(RunProgram(program, true), "error: Stack limit exceeded: too deep recursion");
+    SetStackLimit(kDefaultStackLimit);
+    ASSERT_EQUAL(RunProgram(program, true), "100000\n");
+}
+
+void TestDeepNestedCall() {
+    // __str__ runs in a nested Execute and its recursion grows the call stack far beyond what
+    // the outer tail-calling loop has seen, the loop must still find its own frame afterwards
+    const string program = R"(
+class Node:
+  def depth(n):
+    if n == 0:
+      return 0
+    return 1 + self.depth(n - 1)
+
+  def __str__():
+    return str(self.depth(150000))
+
+  def loop(n):
+    print self
+    if n == 0:
+      return 'done'
+    return self.loop(n - 1)
+
+x = Node()
+r = x.loop(1)
+print r
+)";
+    ASSERT_EQUAL(RunProgram(program, true), "150000\n150000\ndone\n");
+}
+
+void TestDeepRuntimeCalls() {
+    // Methods the runtime calls for printing, arithmetic and comparisons run in nested Executes,
+    // which recurse natively. The limit covers them too, so they fail like any deep recursion.
+    const string countdown = R"(
+class Countdown:
+  def __init__(n):
+    self.n = n
+
+  def __str__():
+    if self.n == 0:
+      return 'done'
+    self.n = self.n - 1
+    return str(self)
+
+  def __add__(other):
+    if self.n == 0:
+      return other
+    self.n = self.n - 1
+    return self + other
+
+  def __eq__(other):
+    if self.n == 0:
+      return True
+    self.n = self.n - 1
+    return self == other
+
+  def __lt__(other):
+    if self.n == 0:
+      return True
+    self.n = self.n - 1
+    return self < other
+)";
+    const string error = "error: Stack limit exceeded: too deep recursion";
+    ASSERT_EQUAL(RunProgram(countdown + "x = Countdown(50000)\nprint x\n", true), error);
+    // The native stack they take counts against a smaller limit as well
+    SetStackLimit(64 << 10);
+    for (const char *use : {"print x + 1\n", "print x == 0\n", "print x < 0\n"}) {
+        ASSERT_EQUAL(RunProgram(countdown + "x = Countdown(50000)\n" + use, true), error);
+    }
+    SetStackLimit(kDefaultStackLimit);
+    ASSERT_EQUAL(RunProgram(countdown + "x = Countdown(100)\nprint x\n", true), "done\n");
+}
+
+void TestTreeWalkerIgnoresCode() {
+    // Compiling attaches code to the methods of the tree, the tree walker must still run their
+    // bodies. The VM's frames wouldn't fit into the small limit.
+    istringstream input(R"(
+class Counter:
+  def depth(n):
+    if n == 0:
+      return 0
+    return 1 + self.depth(n - 1)
+
+c = Counter()
+print c.depth(200)
+)");
+    Parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+    auto code = CompileProgram(*tree);
+
+    ostringstream output;
+    Ast::Print::SetOutputStream(output);
+    SetStackLimit(1 << 10);
+    ASSERT_THROWS(Run(*code), runtime_error);
+    Runtime::Closure closure;
+    tree->Execute(closure);
+    SetStackLimit(kDefaultStackLimit);
+    ASSERT_EQUAL(output.str(), "200\n");
+}
+
+void TestNestedClasses() {
+    ASSERT_SAME_OUTPUT(R"(
+class Factory:
+  def make(value):
+    class Box:
+      def __init__(value):
+        self.value = value
+
+      def get():
+        return self.value
+    return Box(value)
+
+f = Factory()
+b = f.make(5)
+print b.get(), b.value
+)", "5 5\n");
+}
+
+void TestErrors() {
+    ASSERT_SAME_OUTPUT(R"(
+class A:
+  def f(flag):
+    if flag:
+      x = 1
+    else:
+      return 2
+    return x
+
+  def g(flag):
+    if flag:
+      y = 1
+    return y
+
+a = A()
+print a.f(True), a.f(False), a.g(True)
+print a.g(False)
+)", "1 2 1\nerror: Variable y not found in closure");
+
+    ASSERT_SAME_OUTPUT("print 1 / 0", "error: Division by zero");
+    ASSERT_SAME_OUTPUT("print z", "error: Variable z not found in closure");
+    ASSERT_SAME_OUTPUT("x = 1\nprint x.y", "error: x is not an object, can't access its fields");
+    ASSERT_SAME_OUTPUT("print q.w", "error: Name q not found in the scope");
+    ASSERT_SAME_OUTPUT(R"(
+class A:
+  def f():
+    return self.inner.value
+
+a = A()
+a.b = A()
+print a.b.c.d
+)", "error: Name c not found in the scope");
+    ASSERT_SAME_OUTPUT("class A:\n  def f():\n    return self.inner.value\n\na = A()\nprint a.f()",
+                       "error: Name inner not found in the scope");
+    ASSERT_SAME_OUTPUT("x = 1\nx.y = 2", "error: Cannot assign to the field y of not an object");
+    ASSERT_SAME_OUTPUT("x = 1\nx.f()", "error: Trying to call method f on object whicj is not a class instance");
+    ASSERT_SAME_OUTPUT(R"(
+class A:
+  def f():
+    return self.missing
+
+a = A()
+print a.f()
+)", "error: Variable missing not found in closure");
+}
+
+void RunBytecodeTests(TestRunner &tr) {
+    RUN_TEST(tr, TestExpressions);
+    RUN_TEST(tr, TestComparisons);
+    RUN_TEST(tr, TestMethods);
+    RUN_TEST(tr, TestRichComparisons);
+    RUN_TEST(tr, TestEvaluationOrder);
+    RUN_TEST(tr, TestLoops);
+    RUN_TEST(tr, TestTailCalls);
+    RUN_TEST(tr, TestDeepRecursion);
+    RUN_TEST(tr, TestDeepNestedCall);
+    RUN_TEST(tr, TestDeepRuntimeCalls);
+    RUN_TEST(tr, TestTreeWalkerIgnoresCode);
+    RUN_TEST(tr, TestNestedClasses);
+    RUN_TEST(tr, TestErrors);
+}
+
+}
@@ -12,53 +12,116 @@ using namespace std;
 namespace Runtime {
 
 template<typename T, typename Cmp>
-optional<bool> TryCompare(const ObjectHolder &lhs, const ObjectHolder &rhs, Cmp cmp) {
-    auto l = lhs.TryAs<T>();
-    auto r = rhs.TryAs<T>();
-    if (l && r) {
-        return cmp(l->GetValue(), r->GetValue());
-    } else {
-        return nullopt;
+bool CompareObjectValues(const ObjectHolder &lhs, const ObjectHolder &rhs, Cmp cmp) {
+    return cmp(lhs.TryAs<T>()->GetValue(), rhs.TryAs<T>()->GetValue());
+}
+
+namespace {
+
+// Instance on the left of a comparison, nullptr if lhs isn't one
+Runtime::ClassInstance *LeftInstance(const ObjectHolder &lhs) {
+    // Only the holder is const: the instance it shares may be changed by its own methods
+    return const_cast<Runtime::ClassInstance *>(lhs.TryAs<Runtime::ClassInstance>());
+}
+
+// Result of the method the instance on the left has for the slot. Nothing if lhs isn't an
+// instance or doesn't define it.
+optional<bool> CallComparison(const ObjectHolder &lhs, const ObjectHolder &rhs, SpecialMethod::Slot slot) {
+    if (auto *self = LeftInstance(lhs)) {
+        if (auto *method = self->GetClass().GetMethod(slot)) {
+            return IsTrue(self->Invoke(*method, {rhs}));
+        }
     }
+    return nullopt;
 }
 
-bool Equal(ObjectHolder lhs, ObjectHolder rhs) {
-    auto result = TryCompare<Runtime::Number>(lhs, rhs, std::equal_to<int>());
-    if (!result) {
-        result = TryCompare<Runtime::String>(lhs, rhs, std::equal_to<string>());
+// Result of the comparison method of the instance on the left, or of its __cmp__ turned
+// into the operator's answer. Nothing if lhs isn't an instance or defines neither of them.
+template<typename Cmp>
+optional<bool> CompareInstance(const ObjectHolder &lhs, const ObjectHolder &rhs, SpecialMethod::Slot slot, Cmp cmp) {
+    if (auto result = CallComparison(lhs, rhs, slot)) {
+        return result;
     }
-    if (!result) {
-        result = TryCompare<Runtime::Bool>(lhs, rhs, std::equal_to<bool>());
+    auto *self = LeftInstance(lhs);
+    if (!self) {
+        return nullopt;
     }
-    if (result) {
-        return *result;
+    if (auto *three_way = self->GetClass().GetMethod(SpecialMethod::Slot::Cmp)) {
+        auto order = self->Invoke(*three_way, {rhs});
+        if (auto number = order.TryAs<Runtime::Number>()) {
+            return cmp(number->GetValue(), 0);
+        }
+        throw std::runtime_error("__cmp__ must return a number");
     }
-    if (auto p = lhs.TryAs<Runtime::ClassInstance>(); p && p->HasMethod("__eq__", 1)) {
-        return IsTrue(p->Call("__eq__", {rhs}));
+    return nullopt;
+}
+}
+
+bool Equal(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    switch (KindPair(lhs.GetKind(), rhs.GetKind())) {
+        case KindPair(Kind::Number, Kind::Number):
+            return CompareObjectValues<Runtime::Number>(lhs, rhs, std::equal_to<int>());
+        case KindPair(Kind::String, Kind::String):
+            return CompareObjectValues<Runtime::String>(lhs, rhs, std::equal_to<string>());
+        case KindPair(Kind::Bool, Kind::Bool):
+            return CompareObjectValues<Runtime::Bool>(lhs, rhs, std::equal_to<bool>());
+        case KindPair(Kind::None, Kind::None):
+            return true;
+        default:
+            break;
     }
-    if (!lhs && !rhs) {
-        return true;
+    if (auto result = CompareInstance(lhs, rhs, SpecialMethod::Slot::Eq, std::equal_to<int>())) {
+        return *result;
     }
 
     throw std::runtime_error("Cannot compare objects for equality");
 }
 
-bool Less(ObjectHolder lhs, ObjectHolder rhs) {
-    auto result = TryCompare<Runtime::Number>(lhs, rhs, std::less<int>());
-    if (!result) {
-        result = TryCompare<Runtime::String>(lhs, rhs, std::less<string>());
+bool Less(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    switch (KindPair(lhs.GetKind(), rhs.GetKind())) {
+        case KindPair(Kind::Number, Kind::Number):
+            return CompareObjectValues<Runtime::Number>(lhs, rhs, std::less<int>());
+        case KindPair(Kind::String, Kind::String):
+            return CompareObjectValues<Runtime::String>(lhs, rhs, std::less<string>());
+        case KindPair(Kind::Bool, Kind::Bool):
+            return CompareObjectValues<Runtime::Bool>(lhs, rhs, std::less<bool>());
+        default:
+            break;
+    }
+    if (auto result = CompareInstance(lhs, rhs, SpecialMethod::Slot::Lt, std::less<int>())) {
+        return *result;
     }
-    if (!result) {
-        result = TryCompare<Runtime::Bool>(lhs, rhs, std::less<bool>());
+
+    throw std::runtime_error("Cannot compare objects for less");
+}
+
+bool NotEqual(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    // Without __ne__ the answer is the opposite of ==, which prefers __eq__ to __cmp__
+    if (auto result = CallComparison(lhs, rhs, SpecialMethod::Slot::Ne)) {
+        return *result;
     }
-    if (result) {
+    return !Equal(lhs, rhs);
+}
+
+bool Greater(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    if (auto result = CompareInstance(lhs, rhs, SpecialMethod::Slot::Gt, std::greater<int>())) {
         return *result;
     }
-    if (auto p = lhs.TryAs<Runtime::ClassInstance>(); p && p->HasMethod("__lt__", 1)) {
-        return IsTrue(p->Call("__lt__", {rhs}));
+    return !Less(lhs, rhs) && !Equal(lhs, rhs);
+}
+
+bool LessOrEqual(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    if (auto result = CompareInstance(lhs, rhs, SpecialMethod::Slot::Le, std::less_equal<int>())) {
+        return *result;
     }
+    return !Greater(lhs, rhs);
+}
 
-    throw std::runtime_error("Cannot compare objects for less");
+bool GreaterOrEqual(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    if (auto result = CompareInstance(lhs, rhs, SpecialMethod::Slot::Ge, std::greater_equal<int>())) {
+        return *result;
+    }
+    return !Less(lhs, rhs);
 }
 
 
@@ -5,24 +5,65 @@
 
 namespace Runtime {
 
-bool Equal(ObjectHolder lhs, ObjectHolder rhs);
+bool Equal(const ObjectHolder &lhs, const ObjectHolder &rhs);
 
-bool Less(ObjectHolder lhs, ObjectHolder rhs);
+bool Less(const ObjectHolder &lhs, const ObjectHolder &rhs);
 
-inline bool NotEqual(ObjectHolder lhs, ObjectHolder rhs) {
-    return !Equal(lhs, rhs);
-}
+// A class instance on the left is compared by its method for the operator, or by __cmp__.
+// Without them the operator is derived from Less and Equal. != without __ne__ is always the
+// opposite of ==, so __eq__ goes before __cmp__ for both.
+bool NotEqual(const ObjectHolder &lhs, const ObjectHolder &rhs);
 
-inline bool Greater(ObjectHolder lhs, ObjectHolder rhs) {
-    return !Less(lhs, rhs) && !Equal(lhs, rhs);
-}
+bool Greater(const ObjectHolder &lhs, const ObjectHolder &rhs);
+
+bool LessOrEqual(const ObjectHolder &lhs, const ObjectHolder &rhs);
+
+bool GreaterOrEqual(const ObjectHolder &lhs, const ObjectHolder &rhs);
+
+// Comparison operators of the language
+enum class CompareOp {
+    Less,
+    Greater,
+    Equal,
+    NotEqual,
+    LessOrEqual,
+    GreaterOrEqual,
+};
 
-inline bool LessOrEqual(ObjectHolder lhs, ObjectHolder rhs) {
-    return !Greater(lhs, rhs);
+// Operator applied to plain values such as ints and strings
+template<CompareOp op, typename T>
+bool CompareValues(const T &lhs, const T &rhs) {
+    if constexpr (op == CompareOp::Less) {
+        return lhs < rhs;
+    } else if constexpr (op == CompareOp::Greater) {
+        return lhs > rhs;
+    } else if constexpr (op == CompareOp::Equal) {
+        return lhs == rhs;
+    } else if constexpr (op == CompareOp::NotEqual) {
+        return lhs != rhs;
+    } else if constexpr (op == CompareOp::LessOrEqual) {
+        return lhs <= rhs;
+    } else {
+        return lhs >= rhs;
+    }
 }
 
-inline bool GreaterOrEqual(ObjectHolder lhs, ObjectHolder rhs) {
-    return !Less(lhs, rhs);
+// Operator applied to objects of any types
+template<CompareOp op>
+bool Compare(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    if constexpr (op == CompareOp::Less) {
+        return Less(lhs, rhs);
+    } else if constexpr (op == CompareOp::Greater) {
+        return Greater(lhs, rhs);
+    } else if constexpr (op == CompareOp::Equal) {
+        return Equal(lhs, rhs);
+    } else if constexpr (op == CompareOp::NotEqual) {
+        return NotEqual(lhs, rhs);
+    } else if constexpr (op == CompareOp::LessOrEqual) {
+        return LessOrEqual(lhs, rhs);
+    } else {
+        return GreaterOrEqual(lhs, rhs);
+    }
 }
 
 } /* namespace Runtime */
@@ -0,0 +1,510 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+
+using namespace std;
+
+namespace Bytecode {
+
+namespace {
+
+constexpr uint32_t kNoRegister = -1;
+
+void CompileMethod(Runtime::Method &method);
+
+OpCode CompareOpCode(Runtime::CompareOp op) {
+    switch (op) {
+        case Runtime::CompareOp::Less:
+            return OpCode::Less;
+        case Runtime::CompareOp::Greater:
+            return OpCode::Greater;
+        case Runtime::CompareOp::Equal:
+            return OpCode::Equal;
+        case Runtime::CompareOp::NotEqual:
+            return OpCode::NotEqual;
+        case Runtime::CompareOp::LessOrEqual:
+            return OpCode::LessOrEqual;
+        default:
+            return OpCode::GreaterOrEqual;
+    }
+}
+
+// Names of the top-level program. The resolver leaves them to the closure,
+// the compiler gives them registers like to any other locals.
+class GlobalsCollector : public Ast::Visitor {
+ public:
+    using Visitor::Visit;
+
+    void Visit(Ast::VariableValue &node) override {
+        Add(node.dotted_ids.front());
+    }
+
+    void Visit(Ast::Assignment &node) override {
+        Visitor::Visit(node);
+        Add(node.var_name);
+    }
+
+    void Visit(Ast::ClassDefinition &node) override {
+        Add(node.class_name);
+    }
+
+    unordered_map<Symbol, uint32_t> TakeGlobals() {
+        return std::move(globals);
+    }
+
+ private:
+    void Add(Symbol name) {
+        globals.emplace(name, globals.size());
+    }
+
+    unordered_map<Symbol, uint32_t> globals;
+};
+
+class Compiler : public Ast::Visitor {
+ public:
+    // The first initialized locals are set before the code starts: self and the parameters
+    Compiler(Function &function, size_t local_count, size_t initialized, unordered_map<Symbol, uint32_t> globals)
+        : function(function), globals(std::move(globals)), next_temp(local_count), in_method(initialized > 0) {
+        function.register_count = local_count;
+        flow.assigned.assign(local_count, false);
+        fill_n(flow.assigned.begin(), initialized, true);
+    }
+
+    void CompileBody(Ast::Statement &body) {
+        CompileStatement(body);
+        Emit(OpCode::ReturnNone);
+    }
+
+    using Visitor::Visit;
+
+    void Visit(Ast::NumericConst &node) override {
+        LoadConstant(node);
+    }
+
+    void Visit(Ast::StringConst &node) override {
+        LoadConstant(node);
+    }
+
+    void Visit(Ast::BoolConst &node) override {
+        LoadConstant(node);
+    }
+
+    void Visit(Ast::None &) override {
+        auto target = TakeTarget();
+        result = Destination(target, next_temp);
+        Emit(OpCode::LoadNone, result);
+    }
+
+    void Visit(Ast::VariableValue &node) override {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+        const auto &ids = node.dotted_ids;
+
+        uint32_t value = ReadLocal(LocalRegister(node.slot, ids.front()), ids.front(), ids.size() == 1);
+        for (size_t i = 1; i < ids.size(); ++i) {
+            auto site = static_cast<uint32_t>(function.field_sites.size());
+            function.field_sites.push_back({ids[i], ids[i - 1], i + 1 == ids.size(), {}});
+
+            uint32_t dst;
+            if (i + 1 == ids.size()) {
+                dst = Destination(target, mark);
+            } else {
+                next_temp = mark;
+                dst = NewTemp();
+            }
+            Emit(OpCode::GetField, dst, value, site);
+            value = dst;
+        }
+        result = value;
+    }
+
+    void Visit(Ast::Assignment &node) override {
+        TakeTarget();
+        auto reg = LocalRegister(node.slot, node.var_name);
+        CompileTo(*node.right_value, reg);
+        flow.assigned[reg] = true;
+        result = reg;
+    }
+
+    void Visit(Ast::FieldAssignment &node) override {
+        TakeTarget();
+        auto object = Compile(node.object);
+
+        auto site = static_cast<uint32_t>(function.field_sites.size());
+        function.field_sites.push_back({node.field_name, {}, false, {}});
+
+        // The tree walker checks the object before it evaluates the value
+        Emit(OpCode::CheckInstance, object, site);
+        auto value = Compile(*node.right_value);
+        Emit(OpCode::SetField, object, value, site);
+        result = value;
+    }
+
+    void Visit(Ast::Print &node) override {
+        TakeTarget();
+        for (size_t i = 0; i < node.args.size(); ++i) {
+            // Like the tree walker, print the separator before evaluating the next argument
+            if (i > 0) {
+                Emit(OpCode::PrintSpace);
+            }
+            auto mark = next_temp;
+            Emit(OpCode::Print, Compile(*node.args[i]));
+            next_temp = mark;
+        }
+        Emit(OpCode::PrintNewline);
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::MethodCall &node) override {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+
+        auto args = CompileArguments(node.args);
+        auto object = Compile(*node.object);
+        auto site = AddCallSite(node, args);
+
+        result = Destination(target, mark);
+        Emit(OpCode::Call, result, object, site);
+    }
+
+    void Visit(Ast::NewInstance &node) override {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+
+        // Like the tree walker, evaluate the arguments only if there is __init__ to pass them to
+        uint32_t args = next_temp;
+        uint32_t argument_count = 0;
+        if (node.class_.GetMethod(Runtime::SpecialMethod::Slot::Init)) {
+            args = CompileArguments(node.args);
+            argument_count = static_cast<uint32_t>(node.args.size());
+        }
+
+        auto site = static_cast<uint32_t>(function.new_sites.size());
+        function.new_sites.push_back({&node.class_, args, argument_count});
+
+        result = Destination(target, mark);
+        Emit(OpCode::New, result, site);
+    }
+
+    void Visit(Ast::Stringify &node) override {
+        CompileUnary(OpCode::Str, node);
+    }
+
+    void Visit(Ast::Add &node) override {
+        CompileBinary(OpCode::Add, node);
+    }
+
+    void Visit(Ast::Sub &node) override {
+        CompileBinary(OpCode::Sub, node);
+    }
+
+    void Visit(Ast::Mult &node) override {
+        CompileBinary(OpCode::Mult, node);
+    }
+
+    void Visit(Ast::Div &node) override {
+        CompileBinary(OpCode::Div, node);
+    }
+
+    void Visit(Ast::Or &node) override {
+        CompileLogical(OpCode::JumpIfTrue, node);
+    }
+
+    void Visit(Ast::And &node) override {
+        CompileLogical(OpCode::JumpIfFalse, node);
+    }
+
+    void Visit(Ast::Not &node) override {
+        CompileUnary(OpCode::Not, node);
+    }
+
+    void Visit(Ast::Negate &node) override {
+        CompileUnary(OpCode::Negate, node);
+    }
+
+    void Visit(Ast::Compound &node) override {
+        TakeTarget();
+        for (auto &stmt : node.statements) {
+            CompileStatement(*stmt);
+        }
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::Return &node) override {
+        TakeTarget();
+        // A returned call replaces the running method in its frame
+        if (auto *call = dynamic_cast<Ast::MethodCall *>(node.statement.get()); call && in_method) {
+            auto args = CompileArguments(call->args);
+            auto object = Compile(*call->object);
+            Emit(OpCode::TailCall, object, AddCallSite(*call, args));
+        } else {
+            Emit(OpCode::Return, Compile(*node.statement));
+        }
+        flow.returned = true;
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::ClassDefinition &node) override {
+        TakeTarget();
+        auto reg = LocalRegister(node.slot, node.class_name);
+        Emit(OpCode::LoadConst, reg, Constant(node.cls));
+        flow.assigned[reg] = true;
+
+        for (auto &method : node.cls.TryAs<Runtime::Class>()->GetMethods()) {
+            CompileMethod(method);
+        }
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::IfElse &node) override {
+        TakeTarget();
+        auto mark = next_temp;
+        auto skip_if = Emit(OpCode::JumpIfFalse, Compile(*node.condition));
+        next_temp = mark;
+
+        Flow before = flow;
+        CompileStatement(*node.if_body);
+        if (node.else_body) {
+            auto skip_else = Emit(OpCode::Jump);
+            PatchJump(skip_if);
+
+            Flow after_if = std::move(flow);
+            flow = std::move(before);
+            CompileStatement(*node.else_body);
+            Merge(after_if);
+            PatchJump(skip_else);
+        } else {
+            PatchJump(skip_if);
+            Merge(before);
+        }
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::While &node) override {
+        TakeTarget();
+        auto mark = next_temp;
+        auto start = static_cast<uint32_t>(function.code.size());
+        auto exit = Emit(OpCode::JumpIfFalse, Compile(*node.condition));
+        next_temp = mark;
+
+        // The loop is left only when the condition is checked, and at that point
+        // the body may not have run at all
+        Flow before = flow;
+        CompileStatement(*node.body);
+        Emit(OpCode::Jump, start);
+        PatchJump(exit);
+        flow = std::move(before);
+        result = kNoRegister;
+    }
+
+    void Visit(Ast::Comparison &node) override {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+        auto lhs = Compile(*node.left);
+        auto rhs = Compile(*node.right);
+
+        result = Destination(target, mark);
+        Emit(CompareOpCode(node.op), result, lhs, rhs);
+    }
+
+ private:
+    // Locals that are assigned on every path to the current point of the code.
+    // A path that has returned doesn't restrict anything.
+    struct Flow {
+        vector<bool> assigned;
+        bool returned = false;
+    };
+
+    Function &function;
+    unordered_map<Symbol, uint32_t> globals;
+    Flow flow;
+    uint32_t next_temp;
+    // Only a method's frame can be taken over by a tail call, the program's frame holds its globals
+    bool in_method;
+    // Register the node being compiled should put its value to, if it can
+    uint32_t target = kNoRegister;
+    // Register the node has put its value to
+    uint32_t result = kNoRegister;
+
+    uint32_t Compile(Ast::Statement &node, uint32_t target_register = kNoRegister) {
+        target = target_register;
+        node.Accept(*this);
+        return result;
+    }
+
+    void CompileTo(Ast::Statement &node, uint32_t reg) {
+        if (auto value = Compile(node, reg); value != reg) {
+            Emit(OpCode::Move, reg, value);
+        }
+    }
+
+    void CompileStatement(Ast::Statement &node) {
+        auto mark = next_temp;
+        Compile(node);
+        next_temp = mark;
+    }
+
+    // Puts the values to consecutive registers and returns the first of them
+    uint32_t CompileArguments(vector<unique_ptr<Ast::Statement>> &args) {
+        auto first = Reserve(args.size());
+        for (size_t i = 0; i < args.size(); ++i) {
+            CompileTo(*args[i], first + i);
+            next_temp = first + args.size();
+        }
+        return first;
+    }
+
+    uint32_t AddCallSite(Ast::MethodCall &node, uint32_t args) {
+        auto site = static_cast<uint32_t>(function.call_sites.size());
+        function.call_sites.push_back({node.method, args, static_cast<uint32_t>(node.args.size()), {}});
+        return site;
+    }
+
+    void CompileUnary(OpCode op, Ast::UnaryOperation &node) {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+        auto arg = Compile(*node.argument);
+        result = Destination(target, mark);
+        Emit(op, result, arg);
+    }
+
+    void CompileBinary(OpCode op, Ast::BinaryOperation &node) {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+        auto lhs = Compile(*node.lhs);
+        auto rhs = Compile(*node.rhs);
+        result = Destination(target, mark);
+        Emit(op, result, lhs, rhs);
+    }
+
+    // Or and And: jump_op leaves on the operand value that decides the result
+    void CompileLogical(OpCode jump_op, Ast::BinaryOperation &node) {
+        auto target = TakeTarget();
+        auto mark = next_temp;
+        bool decided_value = jump_op == OpCode::JumpIfTrue;
+
+        auto lhs_decides = Emit(jump_op, Compile(*node.lhs));
+        next_temp = mark;
+        auto rhs_decides = Emit(jump_op, Compile(*node.rhs));
+
+        result = Destination(target, mark);
+        Emit(OpCode::LoadBool, result, !decided_value);
+        auto skip = Emit(OpCode::Jump);
+        PatchJump(lhs_decides);
+        PatchJump(rhs_decides);
+        Emit(OpCode::LoadBool, result, decided_value);
+        PatchJump(skip);
+    }
+
+    template<typename T>
+    void LoadConstant(Ast::ValueStatement<T> &node) {
+        auto target = TakeTarget();
+        result = Destination(target, next_temp);
+
+        Runtime::Closure closure;
+        Emit(OpCode::LoadConst, result, Constant(node.Execute(closure)));
+    }
+
+    uint32_t LocalRegister(size_t slot, Symbol name) const {
+        return slot != Ast::kNoSlot ? static_cast<uint32_t>(slot) : globals.at(name);
+    }
+
+    uint32_t ReadLocal(uint32_t reg, Symbol name, bool last) {
+        if (!flow.returned && !flow.assigned[reg]) {
+            Emit(OpCode::CheckSet, reg, Name(name), last);
+            // The code after the check runs only if the variable is set
+            flow.assigned[reg] = true;
+        }
+        return reg;
+    }
+
+    void Merge(const Flow &other) {
+        if (flow.returned) {
+            flow = other;
+        } else if (!other.returned) {
+            for (size_t i = 0; i < flow.assigned.size(); ++i) {
+                flow.assigned[i] = flow.assigned[i] && other.assigned[i];
+            }
+        }
+    }
+
+    uint32_t TakeTarget() {
+        return exchange(target, kNoRegister);
+    }
+
+    // The target if there is one, otherwise a new temporary in place of those above mark
+    uint32_t Destination(uint32_t target_register, uint32_t mark) {
+        if (target_register != kNoRegister) {
+            return target_register;
+        }
+        next_temp = mark;
+        return NewTemp();
+    }
+
+    uint32_t NewTemp() {
+        return Reserve(1);
+    }
+
+    uint32_t Reserve(size_t count) {
+        auto first = next_temp;
+        next_temp += count;
+        function.register_count = max<size_t>(function.register_count, next_temp);
+        return first;
+    }
+
+    uint32_t Constant(ObjectHolder value) {
+        function.constants.push_back(std::move(value));
+        return static_cast<uint32_t>(function.constants.size() - 1);
+    }
+
+    uint32_t Name(Symbol name) {
+        function.names.push_back(name);
+        return static_cast<uint32_t>(function.names.size() - 1);
+    }
+
+    size_t Emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        function.code.push_back({op, a, b, c});
+        return function.code.size() - 1;
+    }
+
+    // Points a jump emitted earlier to the next instruction
+    void PatchJump(size_t index) {
+        auto &instruction = function.code[index];
+        auto target_index = static_cast<uint32_t>(function.code.size());
+        if (instruction.op == OpCode::Jump) {
+            instruction.a = target_index;
+        } else {
+            instruction.b = target_index;
+        }
+    }
+};
+
+void CompileMethod(Runtime::Method &method) {
+    if (method.frame_size == 0) {
+        // The body wasn't resolved, it can run only in the tree walker
+        return;
+    }
+
+    auto function = make_shared<Function>();
+    Compiler compiler(*function, method.frame_size, method.formal_params.size() + 1, {});
+    compiler.CompileBody(*method.body);
+    method.code = std::move(function);
+}
+
+}
+
+unique_ptr<Function> CompileProgram(Ast::Statement &program) {
+    GlobalsCollector collector;
+    program.Accept(collector);
+    auto globals = collector.TakeGlobals();
+
+    auto function = make_unique<Function>();
+    auto global_count = globals.size();
+    Compiler compiler(*function, global_count, 0, std::move(globals));
+    compiler.CompileBody(program);
+    return function;
+}
+
+}
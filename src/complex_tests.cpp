@@ -1,14 +1,27 @@
 #include "complex_tests.h"
 
 
-void RunProgram(std::istream &input, std::ostream &output) {
-    Ast::Print::SetOutputStream(output);
+// Runs the program in the tree walker and checks that the bytecode VM prints the same
+void RunProgram(std::istream &input, std::ostringstream &output) {
+    std::ostringstream source;
+    source << input.rdbuf();
 
-    Parse::Lexer lexer(input);
+    std::istringstream tree_input(source.str());
+    Ast::Print::SetOutputStream(output);
+    Parse::Lexer lexer(tree_input);
     auto program = ParseProgram(lexer);
 
     Runtime::Closure closure;
     program->Execute(closure);
+
+    std::istringstream bytecode_input(source.str());
+    std::ostringstream bytecode_output;
+    Ast::Print::SetOutputStream(bytecode_output);
+    Parse::Lexer bytecode_lexer(bytecode_input);
+    auto compiled_program = ParseProgram(bytecode_lexer);
+    Bytecode::Run(*Bytecode::CompileProgram(*compiled_program));
+
+    ASSERT_EQUAL(bytecode_output.str(), output.str());
 }
 
 
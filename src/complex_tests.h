@@ -3,6 +3,7 @@
 #include "parse.h"
 #include "lexer.h"
 #include "statement.h"
+#include "bytecode.h"
 
 #include "test_runner.h"
 
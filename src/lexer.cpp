@@ -1,8 +1,14 @@
 #include "lexer.h"
 
-#include <algorithm>
-#include <charconv>
-#include <unordered_map>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 using namespace std;
@@ -48,6 +54,7 @@ std::ostream &operator<<(std::ostream &os, const Token &rhs) {
     UNVALUED_OUTPUT(Return);
     UNVALUED_OUTPUT(If);
     UNVALUED_OUTPUT(Else);
+    UNVALUED_OUTPUT(While);
     UNVALUED_OUTPUT(Def);
     UNVALUED_OUTPUT(Newline);
     UNVALUED_OUTPUT(Print);
@@ -71,57 +78,191 @@ std::ostream &operator<<(std::ostream &os, const Token &rhs) {
 }
 
 
+SourceBuffer::SourceBuffer(istream &input) {
+    owned.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+}
+
+SourceBuffer::SourceBuffer(string text) : owned(std::move(text)) {
+}
+
+SourceBuffer::SourceBuffer(const char *mapped, size_t size) : mapped(mapped), mapped_size(size) {
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : owned(std::move(other.owned)), mapped(other.mapped), mapped_size(other.mapped_size) {
+    other.mapped = nullptr;
+    other.mapped_size = 0;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (mapped) {
+        munmap(const_cast<char *>(mapped), mapped_size);
+    }
+}
+
+SourceBuffer SourceBuffer::MapFile(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Can't open " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            close(fd);
+            return SourceBuffer(static_cast<const char *>(data), info.st_size);
+        }
+    }
+    close(fd);
+    // Empty files can't be mapped, pipes and devices neither
+    ifstream input(path, ios::binary);
+    return SourceBuffer(input);
+}
+
 const int IndentedReader::Eof = std::istream::traits_type::eof();
 
-IndentedReader::IndentedReader(istream &is) : input(is), line_number(0) {
+IndentedReader::IndentedReader(string_view text)
+    : next_line(text.data()), text_end(text.data() + text.size()),
+      position(next_line), line_end(next_line), line_number(0) {
     NextLine();
 }
 
 int IndentedReader::Next() {
-    if (!input) {
-        return Eof;
-    }
-    char c;
-    if (current_line_input >> c) {
-        return c;
-    } else {
-        return '\n';
-    }
+    position = scan.skip_spaces(position, line_end);
+    return Get();
 }
 
 int IndentedReader::Get() {
-    if (!input) {
+    if (exhausted) {
         return Eof;
     }
-    if (int c = current_line_input.get(); c != Eof) {
-        return c;
-    } else {
-        return '\n';
+    if (position != line_end) {
+        return static_cast<unsigned char>(*position++);
     }
+    return '\n';
 }
 
 void IndentedReader::NextLine() {
-    auto is_space = [](char c) { return isspace(c); };
-
-    for (string line; getline(input, line);) {
+    while (next_line != text_end) {
+        const char *begin = next_line;
+        const char *end = static_cast<const char *>(memchr(begin, '\n', text_end - begin));
+        if (end) {
+            next_line = end + 1;
+        } else {
+            end = next_line = text_end;
+        }
         ++line_number;
-        auto it = find_if_not(begin(line), end(line), is_space);
-        if (it != end(line)) {
-            auto leading_spaces = it - begin(line);
+
+        const char *it = scan.skip_spaces(begin, end);
+        if (it != end) {
+            auto leading_spaces = it - begin;
             if (leading_spaces % 2 == 1) {
-                throw LexerError("Odd number of spaces at the beginning of line " + line);
+                throw LexerError("Odd number of spaces at the beginning of line " + string(begin, end));
             }
             current_indent = leading_spaces / 2;
-            current_line_input = istringstream(string(it, end(line)));
+            position = it;
+            line_end = end;
             return;
         }
     }
     // When input is exhausted we must set current_indent to zero to produce enough Dedent tokens
+    exhausted = true;
+    position = line_end = text_end;
     current_indent = 0;
 }
 
-Lexer::Lexer(std::istream &input)
-    : char_reader(input), cur_char(char_reader.Get()), indent(0), current(NextTokenImpl()) {
+namespace {
+
+enum class Keyword {
+    NotKeyword,
+    Class,
+    Return,
+    If,
+    Else,
+    While,
+    Def,
+    Print,
+    And,
+    Or,
+    Not,
+    None,
+    True,
+    False,
+};
+
+// Tells keywords apart by length and first character, so a name is compared with at most one of them
+constexpr Keyword FindKeyword(string_view word) {
+    auto is = [word](string_view keyword, Keyword result) {
+        return word == keyword ? result : Keyword::NotKeyword;
+    };
+    switch (word.size()) {
+        case 2:
+            switch (word[0]) {
+                case 'i': return is("if", Keyword::If);
+                case 'o': return is("or", Keyword::Or);
+            }
+            break;
+        case 3:
+            switch (word[0]) {
+                case 'd': return is("def", Keyword::Def);
+                case 'a': return is("and", Keyword::And);
+                case 'n': return is("not", Keyword::Not);
+            }
+            break;
+        case 4:
+            switch (word[0]) {
+                case 'e': return is("else", Keyword::Else);
+                case 'N': return is("None", Keyword::None);
+                case 'T': return is("True", Keyword::True);
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'c': return is("class", Keyword::Class);
+                case 'w': return is("while", Keyword::While);
+                case 'p': return is("print", Keyword::Print);
+                case 'F': return is("False", Keyword::False);
+            }
+            break;
+        case 6:
+            return is("return", Keyword::Return);
+    }
+    return Keyword::NotKeyword;
+}
+
+static_assert(FindKeyword("while") == Keyword::While && FindKeyword("return") == Keyword::Return);
+static_assert(FindKeyword("whale") == Keyword::NotKeyword && FindKeyword("none") == Keyword::NotKeyword);
+
+Token KeywordToken(Keyword keyword) {
+    using namespace TokenType;
+
+    switch (keyword) {
+        case Keyword::Class: return Class{};
+        case Keyword::Return: return Return{};
+        case Keyword::If: return If{};
+        case Keyword::Else: return Else{};
+        case Keyword::While: return While{};
+        case Keyword::Def: return Def{};
+        case Keyword::Print: return Print{};
+        case Keyword::And: return And{};
+        case Keyword::Or: return Or{};
+        case Keyword::Not: return Not{};
+        case Keyword::None: return None{};
+        case Keyword::True: return True{};
+        case Keyword::False: return False{};
+        case Keyword::NotKeyword: break;
+    }
+    throw LexerError("Not a keyword");
+}
+
+}
+
+Lexer::Lexer(std::istream &input) : Lexer(SourceBuffer(input)) {
+}
+
+Lexer::Lexer(SourceBuffer source)
+    : source(std::move(source)), char_reader(this->source.Text()),
+      cur_char(char_reader.Get()), indent(0), current(NextTokenImpl()) {
 }
 
 const Token &Lexer::CurrentToken() const {
@@ -136,21 +277,6 @@ Token Lexer::NextToken() {
 Token Lexer::NextTokenImpl() {
     using namespace TokenType;
 
-    static const unordered_map<string, Token> keywords = {
-        {"class",  Class{}},
-        {"return", Return{}},
-        {"if",     If{}},
-        {"else",   Else{}},
-        {"def",    Def{}},
-        {"print",  Print{}},
-        {"and",    And{}},
-        {"or",     Or{}},
-        {"not",    Not{}},
-        {"None",   None{}},
-        {"True",   True{}},
-        {"False",  False{}},
-    };
-
     if (indent > char_reader.CurrentIndent()) {
         --indent;
         return Dedent{};
@@ -171,37 +297,46 @@ Token Lexer::NextTokenImpl() {
 
     if (cur_char == IndentedReader::Eof) {
         return Eof{};
-    } else if (isdigit(cur_char)) {
+    }
+
+    // cur_char has just been read, so a token starting with it starts one character before the position.
+    // Runs of digits and name characters can't cross a line break, so they are scanned up to the end
+    // of the text, which leaves more room for whole vector blocks.
+    const char *token_begin = char_reader.Position() - 1;
+    if (isdigit(cur_char)) {
+        const char *end = scan.skip_digits(token_begin + 1, char_reader.TextEnd());
         int value = 0;
-        while (isdigit(cur_char)) {
-            value = value * 10 + (cur_char - '0');
-            cur_char = char_reader.Get();
+        for (const char *it = token_begin; it != end; ++it) {
+            value = value * 10 + (*it - '0');
         }
+        char_reader.Seek(end);
+        cur_char = char_reader.Get();
         return Number{value};
     } else if (cur_char == '"' || cur_char == '\'') {
-        auto opener = cur_char;
-        bool previous_backslash = false;
-        string value;
-        while (((cur_char = char_reader.Get()) != opener || previous_backslash) && cur_char != '\n') {
-            value += cur_char;
-            previous_backslash = (cur_char == '\\');
+        const char opener = cur_char;
+        const char *value_begin = token_begin + 1;
+        const char *line_end = char_reader.LineEnd();
+        // A quote right after a backslash doesn't close the string
+        const char *it = scan.find_quote(value_begin, line_end, opener);
+        while (it != line_end && it[-1] == '\\') {
+            it = scan.find_quote(it + 1, line_end, opener);
         }
-        if (cur_char != opener) {
-            throw LexerError("String " + value + " has unbalanced quotes");
+        if (it == line_end) {
+            throw LexerError("String " + string(value_begin, it) + " has unbalanced quotes");
         }
+        char_reader.Seek(it + 1);
         cur_char = char_reader.Next();
-        return String{std::move(value)};
+        return String{string_view(value_begin, it - value_begin)};
     } else if (isalpha(cur_char) || cur_char == '_') {
-        string value;
-        do {
-            value += cur_char;
-            cur_char = char_reader.Get();
-        } while (isalnum(cur_char) || cur_char == '_');
-
-        if (auto it = keywords.find(value); it != keywords.end()) {
-            return it->second;
+        const char *it = scan.skip_id_chars(token_begin + 1, char_reader.TextEnd());
+        char_reader.Seek(it);
+        cur_char = char_reader.Get();
+
+        string_view value(token_begin, it - token_begin);
+        if (Keyword keyword = FindKeyword(value); keyword != Keyword::NotKeyword) {
+            return KeywordToken(keyword);
         } else {
-            return Id{std::move(value)};
+            return Id{value};
         }
     } else if (cur_char == '=') {
         cur_char = char_reader.Get();
@@ -242,4 +377,70 @@ Token Lexer::NextTokenImpl() {
     }
 }
 
+namespace {
+
+template<typename T, size_t I = 0>
+constexpr size_t IndexOf() {
+    if constexpr (is_same_v<variant_alternative_t<I, TokenBase>, T>) {
+        return I;
+    } else {
+        return IndexOf<T, I + 1>();
+    }
+}
+
+// Token of every type with an empty or zero value
+template<size_t... I>
+const Token &Prototype(size_t type, index_sequence<I...>) {
+    static const Token prototypes[] = {Token(in_place_index<I>)...};
+    return prototypes[type];
+}
+
+}
+
+TokenArray::TokenArray(Lexer &lexer) {
+    for (;; lexer.NextToken()) {
+        Append(lexer.CurrentToken(), lexer.CurrentLineNumber());
+        if (lexer.CurrentToken().Is<TokenType::Eof>()) {
+            return;
+        }
+    }
+}
+
+void TokenArray::Append(const Token &token, int line_number) {
+    using namespace TokenType;
+
+    Entry entry{static_cast<uint8_t>(token.index()), 0};
+    if (auto number = token.TryAs<Number>()) {
+        entry.payload = static_cast<uint32_t>(number->value);
+    } else if (auto c = token.TryAs<Char>()) {
+        entry.payload = static_cast<unsigned char>(c->value);
+    } else if (auto str = token.TryAs<String>()) {
+        entry.payload = strings.size();
+        strings.push_back(str->value);
+    } else if (auto id = token.TryAs<Id>()) {
+        entry.payload = names.size();
+        names.push_back(id->value);
+    }
+    tokens.push_back(entry);
+    lines.push_back(line_number);
+}
+
+Token TokenArray::operator[](size_t index) const {
+    using namespace TokenType;
+
+    const Entry &entry = tokens[min(index, tokens.size() - 1)];
+    switch (entry.type) {
+        case IndexOf<Number>():
+            return Number{static_cast<int>(entry.payload)};
+        case IndexOf<Char>():
+            return Char{static_cast<char>(entry.payload)};
+        case IndexOf<String>():
+            return String{strings[entry.payload]};
+        case IndexOf<Id>():
+            return Id{names[entry.payload]};
+        default:
+            return Prototype(entry.type, make_index_sequence<variant_size_v<TokenBase>>());
+    }
+}
+
 } /* namespace Parse */
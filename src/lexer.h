@@ -1,11 +1,18 @@
 #pragma once
 
+#include "scan.h"
+#include "symbol.h"
+
+#include <algorithm>
+#include <cstdint>
 #include <iosfwd>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <variant>
 #include <stdexcept>
 #include <optional>
+#include <vector>
 
 
 class TestRunner;
@@ -18,15 +25,16 @@ struct Number {
 };
 
 struct Id {
-    std::string value;
+    Symbol value;
 };
 
 struct Char {
     char value;
 };
 
+// Points into the source buffer of the lexer that produced it
 struct String {
-    std::string value;
+    std::string_view value;
 };
 
 struct Class {
@@ -37,6 +45,8 @@ struct If {
 };
 struct Else {
 };
+struct While {
+};
 struct Def {
 };
 struct Newline {
@@ -80,6 +90,7 @@ using TokenBase = std::variant<
     TokenType::Return,
     TokenType::If,
     TokenType::Else,
+    TokenType::While,
     TokenType::Def,
     TokenType::Newline,
     TokenType::Print,
@@ -126,11 +137,40 @@ class LexerError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+// Whole text of a program in memory, either mapped from a file or read from a stream at once
+class SourceBuffer {
+ public:
+    explicit SourceBuffer(std::istream &input);
+
+    explicit SourceBuffer(std::string text);
+
+    // Falls back to reading the file where files can't be mapped
+    static SourceBuffer MapFile(const std::string &path);
+
+    SourceBuffer(SourceBuffer &&other) noexcept;
+
+    SourceBuffer &operator=(SourceBuffer &&) = delete;
+
+    ~SourceBuffer();
+
+    std::string_view Text() const {
+        return mapped ? std::string_view(mapped, mapped_size) : std::string_view(owned);
+    }
+
+ private:
+    SourceBuffer(const char *mapped, size_t size);
+
+    std::string owned;
+    const char *mapped = nullptr;
+    size_t mapped_size = 0;
+};
+
+// Cursor over the lines of a buffer: skips blank lines and tells the indentation of the current one
 class IndentedReader {
  public:
     static const int Eof;
 
-    explicit IndentedReader(std::istream &input);
+    explicit IndentedReader(std::string_view text);
 
     int CurrentIndent() const {
         return current_indent;
@@ -140,33 +180,55 @@ class IndentedReader {
         return line_number;
     }
 
+    // Next character of the line after whitespace, '\n' at the end of the line
     int Next();
 
+    // Next character of the line, '\n' at the end of the line
     int Get();
 
     void NextLine();
 
+    // Characters of the current line that haven't been read yet
+    const char *Position() const {
+        return position;
+    }
+
+    const char *LineEnd() const {
+        return line_end;
+    }
+
+    const char *TextEnd() const {
+        return text_end;
+    }
+
+    // Moves the position within the current line
+    void Seek(const char *to) {
+        position = to;
+    }
+
  private:
-    std::istream &input;
+    const Scan::Kernels &scan = Scan::Active();
+    const char *next_line;
+    const char *text_end;
+    const char *position;
+    const char *line_end;
+    bool exhausted = false;
     int line_number;
-    std::istringstream current_line_input;
     int current_indent;
 };
 
-class Lexer {
+// Checks of the current token for the parser, over anything with CurrentToken, NextToken
+// and CurrentLineNumber
+template<typename Tokens>
+class TokenExpectations {
  public:
-    explicit Lexer(std::istream &input);
-
-    const Token &CurrentToken() const;
-
-    Token NextToken();
-
     template<typename T>
     const T &Expect() const {
+        const Token &current = Self().CurrentToken();
         if (!current.Is<T>()) {
             std::ostringstream msg;
             msg << "Expect token " << T() << " but got " << current << " at line "
-                << char_reader.CurrentLineNumber();
+                << Self().CurrentLineNumber();
             throw LexerError(msg.str());
         }
         return current.As<T>();
@@ -177,32 +239,147 @@ class Lexer {
         if (auto &token_value = Expect<T>().value; token_value != value) {
             std::ostringstream msg;
             msg << "Expect token with value " << value << " but found " << token_value << " at line "
-                << char_reader.CurrentLineNumber();
+                << Self().CurrentLineNumber();
             throw LexerError(msg.str());
         }
     }
 
     template<typename T>
     const T &ExpectNext() {
-        NextToken();
+        Self().NextToken();
         return Expect<T>();
     }
 
     template<typename T, typename U>
     void ExpectNext(const U &value) {
-        NextToken();
+        Self().NextToken();
         Expect<T>(value);
     }
 
+ private:
+    const Tokens &Self() const {
+        return static_cast<const Tokens &>(*this);
+    }
+
+    Tokens &Self() {
+        return static_cast<Tokens &>(*this);
+    }
+};
+
+class Lexer : public TokenExpectations<Lexer> {
+ public:
+    explicit Lexer(std::istream &input);
+
+    explicit Lexer(SourceBuffer source);
+
+    Lexer(const Lexer &) = delete;
+
+    Lexer &operator=(const Lexer &) = delete;
+
+    const Token &CurrentToken() const;
+
+    Token NextToken();
+
+    int CurrentLineNumber() const {
+        return char_reader.CurrentLineNumber();
+    }
+
  private:
     Token NextTokenImpl();
 
+    const Scan::Kernels &scan = Scan::Active();
+    SourceBuffer source;
     IndentedReader char_reader;
     int cur_char;
     int indent;
     Token current;
 };
 
+// Tokens of a whole program, lexed before parsing starts. Every token takes eight bytes: its type
+// and a payload, which is the character or the number itself, or an index of the string or the
+// name in a side table. Strings still point into the buffer of the lexer, it must outlive the array.
+class TokenArray {
+ public:
+    TokenArray() = default;
+
+    // Takes the tokens the lexer has left, up to and including Eof
+    explicit TokenArray(Lexer &lexer);
+
+    void Append(const Token &token, int line_number);
+
+    size_t Size() const {
+        return tokens.size();
+    }
+
+    // Tokens past the end are Eof
+    Token operator[](size_t index) const;
+
+    // Line the lexer was at when it produced the token
+    int LineNumber(size_t index) const {
+        return lines[std::min(index, lines.size() - 1)];
+    }
+
+ private:
+    struct Entry {
+        uint8_t type;
+        uint32_t payload;
+    };
+
+    std::vector<Entry> tokens;
+    std::vector<int> lines;
+    std::vector<std::string_view> strings;
+    std::vector<Symbol> names;
+};
+
+class TokenPipe;
+
+// Position of the parser in a token array. The array can be filled by a pipe as the parser goes,
+// then the cursor waits for the tokens it hasn't received yet.
+class TokenCursor : public TokenExpectations<TokenCursor> {
+ public:
+    explicit TokenCursor(const TokenArray &tokens) : tokens(tokens), current(tokens[0]) {
+    }
+
+    explicit TokenCursor(TokenPipe &pipe);
+
+    const Token &CurrentToken() const {
+        return current;
+    }
+
+    Token NextToken() {
+        current = Fetch(++index);
+        return current;
+    }
+
+    // Token the given number of tokens ahead of the current one
+    Token Peek(size_t offset) const {
+        return Fetch(index + offset);
+    }
+
+    size_t Index() const {
+        return index;
+    }
+
+    int CurrentLineNumber() const {
+        return tokens.LineNumber(index);
+    }
+
+ private:
+    Token Fetch(size_t at) const {
+        if (pipe && at >= tokens.Size()) {
+            Receive(at);
+        }
+        return tokens[at];
+    }
+
+    void Receive(size_t at) const;
+
+    const TokenArray &tokens;
+    TokenPipe *pipe = nullptr;
+    size_t index = 0;
+    Token current;
+};
+
 void RunLexerTests(TestRunner &test_runner);
 
 } /* namespace Parse */
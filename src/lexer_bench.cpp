@@ -0,0 +1,71 @@
+// Lexer throughput with each set of scanning kernels the processor supports.
+// Usage: SithonLexerBench [script], without a script it lexes a generated program.
+#include "lexer.h"
+#include "scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+
+
+using namespace std;
+
+namespace {
+
+// Program of about the given size with long names, strings and indentation, like generated code has
+string GenerateProgram(size_t size) {
+    string text;
+    for (int i = 0; text.size() < size; ++i) {
+        string n = to_string(i);
+        text += "class GeneratedRecordType_" + n + ":\n";
+        text += "  def compute_weighted_total_" + n + "(first_argument_value, second_argument_value):\n";
+        text += "    accumulated_result_value = first_argument_value * 1234567 + second_argument_value\n";
+        text += "    if accumulated_result_value >= 99999999 and not second_argument_value == None:\n";
+        text += "      print 'accumulated value of record number " + n + " exceeds the limit', accumulated_result_value\n";
+        text += "      return \"overflowed while computing the weighted total\"\n";
+        text += "    return accumulated_result_value\n\n";
+    }
+    return text;
+}
+
+size_t LexAll(Parse::SourceBuffer source) {
+    Parse::Lexer lexer(std::move(source));
+    size_t tokens = 1;
+    while (!lexer.CurrentToken().Is<Parse::TokenType::Eof>()) {
+        lexer.NextToken();
+        ++tokens;
+    }
+    return tokens;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    string text;
+    if (argc > 1) {
+        text = string(Parse::SourceBuffer::MapFile(argv[1]).Text());
+    } else {
+        text = GenerateProgram(size_t(32) << 20);
+    }
+    cout << "input: " << text.size() / double(1 << 20) << " MB" << endl;
+
+    for (auto isa : {Parse::Scan::Isa::Scalar, Parse::Scan::Isa::Sse2, Parse::Scan::Isa::Avx2}) {
+        if (!Parse::Scan::SetActive(isa)) {
+            continue;
+        }
+        double best = 1e9;
+        size_t tokens = 0;
+        for (int run = 0; run < 5; ++run) {
+            // Copied before the clock starts, the lexer only takes the buffer over
+            Parse::SourceBuffer source{text};
+            auto start = chrono::steady_clock::now();
+            tokens = LexAll(std::move(source));
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        cout << Parse::Scan::IsaName(isa) << ": " << text.size() / best / (1 << 20) << " MB/s, "
+             << tokens << " tokens" << endl;
+    }
+    return 0;
+}
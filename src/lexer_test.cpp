@@ -1,6 +1,9 @@
 #include "lexer.h"
 #include "test_runner.h"
 
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <string>
 #include <sstream>
 
@@ -23,13 +26,14 @@ void TestSimpleAssignment() {
 }
 
 void TestKeywords() {
-    istringstream input("class return if else def print or None and not True False");
+    istringstream input("class return if else while def print or None and not True False");
     Lexer lexer(input);
 
     ASSERT_EQUAL(lexer.CurrentToken(), Token(TokenType::Class{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Return{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::If{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Else{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::While{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Def{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Print{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Or{}));
@@ -40,6 +44,17 @@ void TestKeywords() {
     ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::False{}));
 }
 
+void TestKeywordLookalikes() {
+    istringstream input("i iff ore dev an note Nine Tree falsE classes whale prints returns");
+    Lexer lexer(input);
+
+    for (const char *name : {"i", "iff", "ore", "dev", "an", "note", "Nine", "Tree", "falsE", "classes", "whale", "prints"}) {
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(TokenType::Id{name}));
+        lexer.NextToken();
+    }
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(TokenType::Id{"returns"}));
+}
+
 void TestNumbers() {
     istringstream input("42 15 -53");
     Lexer lexer(input);
@@ -320,9 +335,63 @@ void TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine() {
     }
 }
 
+void TestSourceBuffer() {
+    const string text = "if x:\n  print 'text'\n";
+    auto expect_tokens = [](Lexer &lexer) {
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(TokenType::If{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Id{"x"}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Char{':'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Newline{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Indent{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Print{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::String{"text"}));
+        // The payload isn't copied out of the buffer
+        auto value = lexer.CurrentToken().As<TokenType::String>().value;
+        ASSERT_EQUAL(value.data()[-1], '\'');
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Newline{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Dedent{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(TokenType::Eof{}));
+    };
+    {
+        Lexer lexer(SourceBuffer{text});
+        expect_tokens(lexer);
+    }
+    {
+        const string path = "/tmp/sithon_lexer_test_" + to_string(time(nullptr)) + ".sy";
+        ofstream(path) << text;
+        Lexer lexer(SourceBuffer::MapFile(path));
+        remove(path.c_str());
+        expect_tokens(lexer);
+    }
+    ASSERT_THROWS(SourceBuffer::MapFile("/nonexistent/script.sy"), runtime_error);
+}
+
+void TestTokenArray() {
+    const string program = "x = 'one'\n\nif x != -7:\n  print x, \"two\"\n";
+    istringstream streamed_input(program), input(program);
+    Lexer streamed(streamed_input), lexer(input);
+    TokenArray tokens(lexer);
+
+    for (size_t i = 0; i < tokens.Size(); ++i, streamed.NextToken()) {
+        ASSERT_EQUAL(tokens[i], streamed.CurrentToken());
+        ASSERT_EQUAL(tokens.LineNumber(i), streamed.CurrentLineNumber());
+    }
+    ASSERT_EQUAL(tokens.Size(), 19u);
+    ASSERT_EQUAL(tokens[tokens.Size() - 1], Token(TokenType::Eof{}));
+    ASSERT_EQUAL(tokens[tokens.Size() + 10], Token(TokenType::Eof{}));
+    ASSERT_EQUAL(tokens.LineNumber(5), 3);
+
+    TokenCursor cursor(tokens);
+    ASSERT_EQUAL(cursor.Peek(2), Token(TokenType::String{"one"}));
+    ASSERT_EQUAL(cursor.ExpectNext<TokenType::Char>().value, '=');
+    ASSERT_EQUAL(cursor.Index(), 1u);
+    ASSERT_THROWS(cursor.ExpectNext<TokenType::Number>(), LexerError);
+}
+
 void RunLexerTests(TestRunner &tr) {
     RUN_TEST(tr, Parse::TestSimpleAssignment);
     RUN_TEST(tr, Parse::TestKeywords);
+    RUN_TEST(tr, Parse::TestKeywordLookalikes);
     RUN_TEST(tr, Parse::TestNumbers);
     RUN_TEST(tr, Parse::TestIds);
     RUN_TEST(tr, Parse::TestStrings);
@@ -333,6 +402,8 @@ void RunLexerTests(TestRunner &tr) {
     RUN_TEST(tr, Parse::TestExpectNext);
     RUN_TEST(tr, Parse::TestSithonProgram);
     RUN_TEST(tr, Parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
+    RUN_TEST(tr, Parse::TestSourceBuffer);
+    RUN_TEST(tr, Parse::TestTokenArray);
 }
 
 } /* namespace Parse */
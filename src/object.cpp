@@ -1,23 +1,55 @@
 #include "object.h"
 #include "statement.h"
+#include "bytecode.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string_view>
+#include <unordered_set>
 
 
 using namespace std;
 
 namespace Runtime {
 
+namespace {
+const Symbol SelfName = "self";
+
+struct SpecialMethodSignature {
+    SpecialMethod::Slot slot;
+    Symbol name;
+    // Number of arguments the interpreter passes, if it's always the same
+    std::optional<size_t> argument_count;
+};
+
+const SpecialMethodSignature &GetSignature(size_t slot) {
+    using SpecialMethod::Slot;
+    static const SpecialMethodSignature signatures[] = {
+        {Slot::Init, SpecialMethod::Init, nullopt},
+        {Slot::Str, SpecialMethod::Str, 0},
+        {Slot::Add, SpecialMethod::Add, 1},
+        {Slot::Eq, SpecialMethod::Eq, 1},
+        {Slot::Lt, SpecialMethod::Lt, 1},
+        {Slot::Gt, SpecialMethod::Gt, 1},
+        {Slot::Le, SpecialMethod::Le, 1},
+        {Slot::Ge, SpecialMethod::Ge, 1},
+        {Slot::Ne, SpecialMethod::Ne, 1},
+        {Slot::Cmp, SpecialMethod::Cmp, 1},
+    };
+    static_assert(std::size(signatures) == SpecialMethod::kSlotCount);
+    return signatures[slot];
+}
+}
+
 void ClassInstance::Print(std::ostream &os) {
-    if (HasMethod("__str__", 0)) {
-        Call("__str__", {})->Print(os);
+    if (auto *str = class_.GetMethod(SpecialMethod::Slot::Str)) {
+        Invoke(*str, {})->Print(os);
     } else {
         os << this;
     }
 }
 
-bool ClassInstance::HasMethod(const std::string &method, size_t argument_count) const {
+bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
     auto *m = class_.GetMethod(method);
     return m && m->formal_params.size() == argument_count;
 }
@@ -26,56 +58,203 @@ bool StartsWith(string_view what, string_view with) {
     return what.substr(0, with.size()) == with;
 }
 
-ClassInstance::ClassInstance(const Class &cls) : class_(cls) {
+ClassInstance::ClassInstance(const Class &cls) : Object(kKind), class_(cls), shape(cls.GetRootShape()) {
+    slots.reserve(shape->ExpectedFieldCount());
 }
 
-ObjectHolder ClassInstance::Call(const std::string &method, const std::vector<ObjectHolder> &actual_args) {
-    if (auto *m = class_.GetMethod(method); !m) {
-        throw std::runtime_error("Class " + class_.GetName() + " doesn't have method " + method);
-    } else if (m->formal_params.size() != actual_args.size()) {
-        std::ostringstream msg;
-        msg << "Method " << class_.GetName() << "::" << method << " expects "
-            << m->formal_params.size() << " arguments, but " << actual_args.size() << " given";
-        throw std::runtime_error(msg.str());
+ObjectHolder *ClassInstance::FindField(Symbol name) {
+    FieldCache cache;
+    return FindField(name, cache);
+}
+
+const ObjectHolder *ClassInstance::FindField(Symbol name) const {
+    auto slot = shape->FindSlot(name);
+    return slot ? &slots[*slot] : nullptr;
+}
+
+ObjectHolder *ClassInstance::FindField(Symbol name, FieldCache &cache) {
+    if (cache.shape != shape || cache.transition) {
+        if (auto slot = shape->FindSlot(name); !slot) {
+            return nullptr;
+        } else {
+            cache = {shape, nullptr, *slot};
+        }
+    }
+    return &slots[cache.slot];
+}
+
+ObjectHolder &ClassInstance::SetField(Symbol name, ObjectHolder value) {
+    FieldCache cache;
+    return SetField(name, std::move(value), cache);
+}
+
+ObjectHolder &ClassInstance::SetField(Symbol name, ObjectHolder value, FieldCache &cache) {
+    if (cache.shape != shape) {
+        if (auto slot = shape->FindSlot(name); slot) {
+            cache = {shape, nullptr, *slot};
+        } else {
+            cache = {shape, shape->AddField(name), shape->FieldCount()};
+        }
+    }
+    if (cache.transition) {
+        shape = cache.transition;
+        slots.push_back(std::move(value));
     } else {
-        try {
-            Closure closure = {{"self", ObjectHolder::Share(*this)}};
-            for (size_t i = 0; i < actual_args.size(); ++i) {
-                closure[m->formal_params[i]] = actual_args[i];
+        slots[cache.slot] = std::move(value);
+    }
+    return slots[cache.slot];
+}
+
+Shape::Shape() : root(this) {
+}
+
+Shape::Shape(const Shape &parent, Symbol name) : root(parent.root), slots(parent.slots) {
+    slots.emplace(name, slots.size());
+    root->max_field_count = std::max(root->max_field_count, slots.size());
+}
+
+std::optional<size_t> Shape::FindSlot(Symbol name) const {
+    if (auto it = slots.find(name); it != slots.end()) {
+        return it->second;
+    } else {
+        return std::nullopt;
+    }
+}
+
+const Shape *Shape::AddField(Symbol name) const {
+    auto &next = transitions[name];
+    if (!next) {
+        next.reset(new Shape(*this, name));
+    }
+    return next.get();
+}
+
+ObjectHolder ClassInstance::Call(Symbol method, const std::vector<ObjectHolder> &actual_args) {
+    return Invoke(class_.ResolveMethod(method, actual_args.size()), actual_args);
+}
+
+namespace {
+
+bool RunsCompiled(const Method &method) {
+    return method.code && Bytecode::IsRunning();
+}
+
+}
+
+ObjectHolder ClassInstance::Invoke(const Method &method, const std::vector<ObjectHolder> &actual_args) {
+    if (RunsCompiled(method)) {
+        return Bytecode::Invoke(*method.code, *this, actual_args.data(), actual_args.size());
+    } else if (method.frame_size > 0) {
+        ClassInstance *self = this;
+        const Method *current = &method;
+        const std::vector<ObjectHolder> *args = &actual_args;
+        // The tail call being run owns its object and arguments
+        TailCall call;
+        while (true) {
+            TailCall next;
+            {
+                Frame frame(current->frame_size);
+                Closure closure(frame.Slots());
+                closure.Slot(0) = ObjectHolder::Share(*self);
+                for (size_t i = 0; i < args->size(); ++i) {
+                    closure.Slot(i + 1) = (*args)[i];
+                }
+
+                auto result = current->body->Execute(closure);
+                if (!closure.HasTailCall()) {
+                    return closure.IsReturning() ? closure.TakeReturnValue() : result;
+                }
+                next = closure.TakeTailCall();
+            }
+
+            call = std::move(next);
+            self = call.object.TryAs<ClassInstance>();
+            current = call.method;
+            args = &call.args;
+            if (RunsCompiled(*current) || current->frame_size == 0) {
+                return self->Invoke(*current, *args);
             }
-            return m->body->Execute(closure);
-        } catch (ObjectHolder &returned_value) {
-            return returned_value;
         }
-        return ObjectHolder::None();
     }
+
+    Closure closure = {{SelfName, ObjectHolder::Share(*this)}};
+    for (size_t i = 0; i < actual_args.size(); ++i) {
+        closure[method.formal_params[i]] = actual_args[i];
+    }
+
+    auto result = method.body->Execute(closure);
+    return closure.IsReturning() ? closure.TakeReturnValue() : result;
 }
 
-Class::Class(std::string name, std::vector<Method> methods, const Class *parent)
-    : class_name(std::move(name)), parent(parent) {
-    for (auto &m : methods) {
-        if (vmt.find(m.name) != vmt.end()) {
-            throw runtime_error("Class " + class_name + " has duplicate methods with name " + m.name);
-        } else {
-            vmt[m.name] = std::move(m);
+Class::Class(Symbol name, std::vector<Method> methods_, const Class *parent)
+    : Object(kKind), class_name(name), parent(parent), methods(std::move(methods_)),
+      root_shape(std::make_unique<Shape>()) {
+    if (parent) {
+        vmt = parent->vmt;
+    }
+
+    unordered_set<Symbol> own_names;
+    for (const auto &m : methods) {
+        if (!own_names.insert(m.name).second) {
+            throw runtime_error("Class " + class_name.Name() + " has duplicate methods with name " + m.name.Name());
         }
+        vmt[m.name] = &m;
     }
+
+    for (size_t slot = 0; slot < special_methods.size(); ++slot) {
+        const auto &signature = GetSignature(slot);
+        auto *m = GetMethod(signature.name);
+        if (m && signature.argument_count && m->formal_params.size() != *signature.argument_count) {
+            m = nullptr;
+        }
+        special_methods[slot] = m;
+    }
+}
+
+const Method *Class::GetMethod(Symbol name) const {
+    auto it = vmt.find(name);
+    return it != vmt.end() ? it->second : nullptr;
 }
 
-const Method *Class::GetMethod(const std::string &name) const {
-    if (auto it = vmt.find(name); it != vmt.end()) {
-        return &it->second;
-    } else if (parent) {
-        return parent->GetMethod(name);
+const Method &Class::ResolveMethod(Symbol name, size_t argument_count) const {
+    if (auto *m = GetMethod(name); !m) {
+        throw std::runtime_error("Class " + class_name.Name() + " doesn't have method " + name.Name());
     } else {
-        return nullptr;
+        return ResolveMethod(*m, argument_count);
+    }
+}
+
+const Method &Class::ResolveMethod(const Method &method, size_t argument_count) const {
+    if (method.formal_params.size() != argument_count) {
+        std::ostringstream msg;
+        msg << "Method " << class_name << "::" << method.name << " expects "
+            << method.formal_params.size() << " arguments, but " << argument_count << " given";
+        throw std::runtime_error(msg.str());
     }
+    return method;
 }
 
 void Class::Print(ostream &os) {
     os << "Class " << class_name;
 }
 
+MethodCache::Stats MethodCache::stats;
+
+const Method &MethodCache::Lookup(const Class &cls, Symbol name, size_t argument_count) {
+    for (const auto &entry : entries) {
+        if (entry.cls == &cls) {
+            ++stats.hits;
+            return *entry.method;
+        }
+    }
+
+    ++stats.misses;
+    const Method &method = cls.ResolveMethod(name, argument_count);
+    entries[next_entry] = {&cls, &method};
+    next_entry = (next_entry + 1) % kEntries;
+    return method;
+}
+
 void Bool::Print(std::ostream &os) {
     os << (GetValue() ? "True" : "False");
 }
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "object_holder.h"
+#include "value_object.h"
 
+#include <array>
 #include <ostream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 
 
@@ -13,86 +16,219 @@ namespace Ast {
 class Statement;
 }
 
+namespace Bytecode {
+struct Function;
+}
+
 class TestRunner;
 
 namespace Runtime {
 
-class Object {
- public:
-    virtual ~Object() = default;
+// Special methods the interpreter calls by itself
+namespace SpecialMethod {
+inline const Symbol Init = "__init__";
+inline const Symbol Str = "__str__";
+inline const Symbol Add = "__add__";
+inline const Symbol Eq = "__eq__";
+inline const Symbol Lt = "__lt__";
+inline const Symbol Gt = "__gt__";
+inline const Symbol Le = "__le__";
+inline const Symbol Ge = "__ge__";
+inline const Symbol Ne = "__ne__";
+// Three-way comparison: a negative number, zero or a positive number
+inline const Symbol Cmp = "__cmp__";
+
+// Places of the special methods in the table every class fills when it's created
+enum class Slot : uint8_t {
+    Init,
+    Str,
+    Add,
+    Eq,
+    Lt,
+    Gt,
+    Le,
+    Ge,
+    Ne,
+    Cmp,
+};
 
-    virtual void Print(std::ostream &os) = 0;
+constexpr size_t kSlotCount = static_cast<size_t>(Slot::Cmp) + 1;
+}
+
+struct Method {
+    Symbol name;
+    std::vector<Symbol> formal_params;
+    std::unique_ptr<Ast::Statement> body;
+    // Number of local variable slots, self and the parameters included; 0 if the body isn't resolved
+    size_t frame_size = 0;
+    // Compiled body, run whenever the VM calls the method. The tree walker always runs the body.
+    std::shared_ptr<Bytecode::Function> code = nullptr;
 };
 
-template<typename T>
-class ValueObject : public Object {
+// Hidden class of an instance: the names of its fields in the order they were added.
+// Instances which got the same fields in the same order share a shape,
+// so an instance itself keeps only a vector of field values.
+class Shape {
  public:
-    ValueObject(T v) : value(v) {
-    }
+    Shape();
+
+    Shape(const Shape &) = delete;
+
+    Shape &operator=(const Shape &) = delete;
 
-    void Print(std::ostream &os) override {
-        os << value;
+    std::optional<size_t> FindSlot(Symbol name) const;
+
+    // Shape of an instance after adding the field, created on the first request
+    const Shape *AddField(Symbol name) const;
+
+    size_t FieldCount() const {
+        return slots.size();
     }
 
-    const T &GetValue() const {
-        return value;
+    // The most fields any instance of this shape tree has reached so far
+    size_t ExpectedFieldCount() const {
+        return root->max_field_count;
     }
 
  private:
-    T value;
-};
+    Shape(const Shape &parent, Symbol name);
 
-using String = ValueObject<std::string>;
-using Number = ValueObject<int>;
-
-class Bool : public ValueObject<bool> {
- public:
-    using ValueObject<bool>::ValueObject;
-
-    void Print(std::ostream &os) override;
+    const Shape *root;
+    std::unordered_map<Symbol, size_t> slots;
+    mutable std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions;
+    mutable size_t max_field_count = 0;
 };
 
-struct Method {
-    std::string name;
-    std::vector<std::string> formal_params;
-    std::unique_ptr<Ast::Statement> body;
+// Remembers where a field was found the last time, so repeated accesses from the
+// same place of a program to instances of the same shape skip the lookup
+struct FieldCache {
+    const Shape *shape = nullptr;
+    const Shape *transition = nullptr;
+    size_t slot = 0;
 };
 
 class Class : public Object {
  public:
-    explicit Class(std::string name, std::vector<Method> methods, const Class *parent);
+    static constexpr Kind kKind = Kind::Class;
+
+    explicit Class(Symbol name, std::vector<Method> methods, const Class *parent);
 
-    const Method *GetMethod(const std::string &name) const;
+    const Method *GetMethod(Symbol name) const;
 
-    const std::string &GetName() const {
+    // Special method of the class or of its parents. Only __init__ may take any number of
+    // arguments, the others are left out unless they take as many as the interpreter passes.
+    const Method *GetMethod(SpecialMethod::Slot slot) const {
+        return special_methods[static_cast<size_t>(slot)];
+    }
+
+    // Same as GetMethod, but throws if the method doesn't exist or takes another number of arguments
+    const Method &ResolveMethod(Symbol name, size_t argument_count) const;
+
+    // Throws if the method of the class takes another number of arguments
+    const Method &ResolveMethod(const Method &method, size_t argument_count) const;
+
+    Symbol GetName() const {
         return class_name;
     }
 
+    // Number of methods the class has, own and inherited ones
+    size_t MethodCount() const {
+        return vmt.size();
+    }
+
+    // Own methods of the class, not inherited ones
+    std::vector<Method> &GetMethods() {
+        return methods;
+    }
+
+    const Shape *GetRootShape() const {
+        return root_shape.get();
+    }
+
     void Print(std::ostream &os) override;
 
  private:
-    std::string class_name;
+    Symbol class_name;
     const Class *parent;
-    std::unordered_map<std::string, Method> vmt;
+    std::vector<Method> methods;
+    // Flattened table of own methods and everything inherited from the parents. It holds only
+    // the names the class has, so it grows with the depth of the hierarchy, not with the program.
+    std::unordered_map<Symbol, const Method *> vmt;
+    std::array<const Method *, SpecialMethod::kSlotCount> special_methods;
+    std::unique_ptr<Shape> root_shape;
 };
 
 class ClassInstance : public Object {
  public:
+    static constexpr Kind kKind = Kind::ClassInstance;
+
     explicit ClassInstance(const Class &cls);
 
     void Print(std::ostream &os) override;
 
-    ObjectHolder Call(const std::string &method, const std::vector<ObjectHolder> &actual_args);
+    ObjectHolder Call(Symbol method, const std::vector<ObjectHolder> &actual_args);
+
+    // Runs an already resolved method of the instance's class, arguments count isn't checked
+    ObjectHolder Invoke(const Method &method, const std::vector<ObjectHolder> &actual_args);
 
-    bool HasMethod(const std::string &method, size_t argument_count) const;
+    const Class &GetClass() const {
+        return class_;
+    }
 
-    Closure &Fields() { return fields; }
+    bool HasMethod(Symbol method, size_t argument_count) const;
 
-    const Closure &Fields() const { return fields; }
+    ObjectHolder *FindField(Symbol name);
+
+    const ObjectHolder *FindField(Symbol name) const;
+
+    ObjectHolder *FindField(Symbol name, FieldCache &cache);
+
+    ObjectHolder &SetField(Symbol name, ObjectHolder value);
+
+    ObjectHolder &SetField(Symbol name, ObjectHolder value, FieldCache &cache);
+
+    const Shape *GetShape() const {
+        return shape;
+    }
 
  private:
     const Class &class_;
-    Closure fields;
+    const Shape *shape;
+    std::vector<ObjectHolder> slots;
+};
+
+// Inline cache of a call site: methods it has resolved for the last few receiver classes.
+// A call site always passes the same number of arguments, so a hit needs no checks at all.
+class MethodCache {
+ public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    const Method &Lookup(const Class &cls, Symbol name, size_t argument_count);
+
+    // Totals over all call sites since the last reset
+    static const Stats &GetStats() {
+        return stats;
+    }
+
+    static void ResetStats() {
+        stats = {};
+    }
+
+ private:
+    struct Entry {
+        const Class *cls = nullptr;
+        const Method *method = nullptr;
+    };
+
+    static constexpr size_t kEntries = 4;
+
+    std::array<Entry, kEntries> entries;
+    size_t next_entry = 0;
+
+    static Stats stats;
 };
 
 void RunObjectsTests(TestRunner &test_runner);
@@ -1,59 +1,149 @@
 #include "object_holder.h"
 #include "object.h"
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
 
 namespace Runtime {
 
+Bool ObjectHolder::true_value(true);
+Bool ObjectHolder::false_value(false);
+
 ObjectHolder ObjectHolder::Share(Object &object) {
-    return ObjectHolder(std::shared_ptr<Object>(&object, [](auto *) { /* do nothing */ }));
+    return ObjectHolder(reinterpret_cast<uintptr_t>(&object) | (object.ref_count > 0 ? kOwning : 0), true);
 }
 
 ObjectHolder ObjectHolder::None() {
     return ObjectHolder();
 }
 
-Object &ObjectHolder::operator*() {
-    return *Get();
+ObjectPtr<Object> ObjectHolder::operator->() {
+    return TryAs<Object>();
 }
 
-const Object &ObjectHolder::operator*() const {
-    return *Get();
+ObjectPtr<const Object> ObjectHolder::operator->() const {
+    return TryAs<Object>();
 }
 
-Object *ObjectHolder::operator->() {
-    return Get();
+Object *ObjectHolder::Get() {
+    return const_cast<Object *>(std::as_const(*this).Get());
 }
 
-const Object *ObjectHolder::operator->() const {
-    return Get();
-}
+namespace {
 
-Object *ObjectHolder::Get() {
-    return data.get();
+class UnsetValue : public Object {
+ public:
+    void Print(std::ostream &os) override {
+        os << "<unset>";
+    }
+};
+
+UnsetValue unset_value;
+
+class FrameStack {
+ public:
+    ObjectHolder *Push(size_t size) {
+        while (current < chunks.size() && chunks[current].used + size > chunks[current].capacity) {
+            if (chunks[current].used == 0) {
+                // An empty chunk is too small for this frame, replace it with a bigger one
+                chunks.erase(chunks.begin() + current);
+            } else {
+                ++current;
+            }
+        }
+        if (current == chunks.size()) {
+            chunks.push_back(MakeChunk(std::max(size, kChunkSize)));
+        }
+
+        auto &chunk = chunks[current];
+        auto *frame = chunk.slots.get() + chunk.used;
+        chunk.used += size;
+        return frame;
+    }
+
+    void Pop(ObjectHolder *frame, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            frame[i] = ObjectHolder::Share(unset_value);
+        }
+        chunks[current].used -= size;
+        while (current > 0 && chunks[current].used == 0) {
+            --current;
+        }
+    }
+
+ private:
+    static constexpr size_t kChunkSize = 4096;
+
+    struct Chunk {
+        std::unique_ptr<ObjectHolder[]> slots;
+        size_t capacity;
+        size_t used;
+    };
+
+    static Chunk MakeChunk(size_t capacity) {
+        Chunk chunk{std::make_unique<ObjectHolder[]>(capacity), capacity, 0};
+        for (size_t i = 0; i < capacity; ++i) {
+            chunk.slots[i] = ObjectHolder::Share(unset_value);
+        }
+        return chunk;
+    }
+
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+};
+
+FrameStack &GetFrameStack() {
+    static FrameStack stack;
+    return stack;
 }
 
-const Object *ObjectHolder::Get() const {
-    return data.get();
 }
 
-ObjectHolder::operator bool() const {
-    return Get();
+Frame::Frame(size_t size) : slots(GetFrameStack().Push(size)), size(size) {
 }
 
-bool IsTrue(ObjectHolder object) {
-    if (!object) {
-        return false;
+Frame::~Frame() {
+    if (slots) {
+        GetFrameStack().Pop(slots, size);
     }
-    if (auto p = object.TryAs<Runtime::Number>(); p && p->GetValue() != 0) {
-        return true;
+}
+
+void Frame::Grow(size_t new_size) {
+    if (new_size <= size) {
+        return;
     }
-    if (auto p = object.TryAs<Runtime::String>(); p && !p->GetValue().empty()) {
-        return true;
+    std::vector<ObjectHolder> values(std::make_move_iterator(slots), std::make_move_iterator(slots + size));
+    GetFrameStack().Pop(slots, size);
+    slots = GetFrameStack().Push(new_size);
+    std::move(values.begin(), values.end(), slots);
+    size = new_size;
+}
+
+void Frame::Clear(size_t first) {
+    for (size_t i = first; i < size; ++i) {
+        slots[i] = ObjectHolder::Share(unset_value);
     }
-    if (auto p = object.TryAs<Runtime::Bool>(); p && p->GetValue()) {
-        return true;
+}
+
+bool Frame::IsUnset(const ObjectHolder &slot) {
+    return slot.Get() == &unset_value;
+}
+
+bool IsTrue(ObjectHolder object) {
+    switch (object.GetKind()) {
+        case Kind::Number:
+            return object.TryAs<Number>()->GetValue() != 0;
+        case Kind::String:
+            return !object.TryAs<String>()->GetValue().empty();
+        case Kind::Bool:
+            return object.TryAs<Bool>()->GetValue();
+        default:
+            return false;
     }
-    return false;
 }
 
 }
@@ -1,62 +1,317 @@
 #pragma once
 
-#include <memory>
+#include "symbol.h"
+#include "value_object.h"
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 
 class TestRunner;
 
 namespace Runtime {
 
-class Object;
+struct Method;
+
+// Kind shared by every object of type T, or Kind::Other when T doesn't declare one
+template<typename T, typename = void>
+constexpr Kind StaticKind = Kind::Other;
+
+template<typename T>
+constexpr Kind StaticKind<T, std::void_t<decltype(T::kKind)>> = T::kKind;
+
+// Pointer to the object behind a holder. A number stored right in the holder has no object,
+// so the pointer makes one that lives as long as the pointer.
+template<typename T>
+class ObjectPtr {
+ public:
+    ObjectPtr(T *object = nullptr) : object(object) {
+    }
+
+    explicit ObjectPtr(int value) : object(nullptr), number(std::in_place, value) {
+    }
+
+    T *Get() const {
+        return object || !number ? object : &*number;
+    }
+
+    T *operator->() const {
+        return Get();
+    }
+
+    T &operator*() const {
+        return *Get();
+    }
+
+    explicit operator bool() const {
+        return object || number;
+    }
+
+    friend bool operator==(const ObjectPtr &lhs, const T *rhs) {
+        return lhs.Get() == rhs;
+    }
+
+ private:
+    T *object;
+    mutable std::optional<Number> number;
+};
 
+// A single word: a pointer whose low bits tell whether the holder owns the object,
+// or a number stored right in the word. Booleans point to two shared objects.
+// Owning holders maintain the object's intrusive reference counter, the
+// interpreter is single-threaded, so the counter is a plain integer.
 class ObjectHolder {
  public:
+    // What TryAs<T> returns: numbers have no object, so anything a number can be
+    // converted to comes as ObjectPtr
+    template<typename T>
+    using Pointer = std::conditional_t<std::is_base_of_v<T, Number>, ObjectPtr<T>, T *>;
+
+    // Owning these doesn't allocate: numbers go into the word, booleans point to the shared objects
+    template<typename T>
+    static constexpr bool IsImmediate = std::is_same_v<T, Number> || std::is_same_v<T, Bool>;
+
     ObjectHolder() = default;
 
+    ObjectHolder(const ObjectHolder &other) : bits(other.bits) {
+        Acquire();
+    }
+
+    ObjectHolder(ObjectHolder &&other) noexcept : bits(std::exchange(other.bits, 0)) {
+    }
+
+    ObjectHolder &operator=(ObjectHolder other) noexcept {
+        std::swap(bits, other.bits);
+        return *this;
+    }
+
+    ~ObjectHolder() {
+        if ((bits & kOwning) && --Pointee()->ref_count == 0) {
+            delete Pointee();
+        }
+    }
+
     template<typename T>
     static ObjectHolder Own(T &&object) {
-        return ObjectHolder(
-            std::make_shared<T>(std::forward<T>(object))
-        );
+        using Type = std::decay_t<T>;
+        if constexpr (std::is_same_v<Type, Number>) {
+            if (FitsInWord(object.GetValue())) {
+                return ObjectHolder(static_cast<uintptr_t>(static_cast<intptr_t>(object.GetValue())) << kTagBits | kNumber);
+            }
+        } else if constexpr (std::is_same_v<Type, Bool>) {
+            return Share(object.GetValue() ? true_value : false_value);
+        }
+        return ObjectHolder(reinterpret_cast<uintptr_t>(new Type(std::forward<T>(object))) | kOwning, true);
     }
 
+    // Refers to an object without taking it over. If the object is already
+    // owned by some holder, the result keeps it alive like any other copy,
+    // otherwise (e.g. for objects on the stack) it's a plain borrowed pointer.
     static ObjectHolder Share(Object &object);
 
     static ObjectHolder None();
 
-    Object &operator*();
+    ObjectPtr<Object> operator->();
 
-    const Object &operator*() const;
-
-    Object *operator->();
-
-    const Object *operator->() const;
+    ObjectPtr<const Object> operator->() const;
 
+    // The object the holder refers to, nullptr for None and for numbers stored in the holder
     Object *Get();
 
     const Object *Get() const;
 
+    Kind GetKind() const;
+
     template<typename T>
-    T *TryAs() {
-        return dynamic_cast<T *>(this->Get());
+    Pointer<T> TryAs() {
+        if constexpr (std::is_base_of_v<T, Number>) {
+            if (bits & kNumber) {
+                return Pointer<T>(GetNumber());
+            }
+            return const_cast<T *>(std::as_const(*this).template TryAs<T>().Get());
+        } else {
+            return const_cast<T *>(std::as_const(*this).template TryAs<T>());
+        }
     }
 
     template<typename T>
-    const T *TryAs() const {
-        return dynamic_cast<const T *>(this->Get());
+    Pointer<const T> TryAs() const {
+        if constexpr (std::is_base_of_v<T, Number>) {
+            if (bits & kNumber) {
+                return Pointer<const T>(GetNumber());
+            }
+        }
+        if constexpr (std::is_same_v<T, Object>) {
+            return Get();
+        } else if constexpr (StaticKind<T> != Kind::Other) {
+            return GetKind() == StaticKind<T> ? static_cast<const T *>(Get()) : nullptr;
+        } else {
+            return dynamic_cast<const T *>(Get());
+        }
     }
 
-    explicit operator bool() const;
+    explicit operator bool() const {
+        return bits;
+    }
 
  private:
-    ObjectHolder(std::shared_ptr<Object> data) : data(std::move(data)) {
+    static constexpr uintptr_t kOwning = 1;
+    static constexpr uintptr_t kNumber = 2;
+    static constexpr int kTagBits = 2;
+
+    static_assert(alignof(Object) > (kOwning | kNumber), "object pointers need two free low bits");
+
+    static bool FitsInWord(int value) {
+        return value >= (INTPTR_MIN >> kTagBits) && value <= (INTPTR_MAX >> kTagBits);
+    }
+
+    explicit ObjectHolder(uintptr_t bits, bool acquire = false) : bits(bits) {
+        if (acquire) {
+            Acquire();
+        }
+    }
+
+    void Acquire() const {
+        if (bits & kOwning) {
+            ++Pointee()->ref_count;
+        }
+    }
+
+    Object *Pointee() const {
+        return reinterpret_cast<Object *>(bits & ~(kOwning | kNumber));
+    }
+
+    int GetNumber() const {
+        return static_cast<int>(static_cast<intptr_t>(bits) >> kTagBits);
     }
 
-    std::shared_ptr<Object> data;
+    static Bool true_value;
+    static Bool false_value;
+
+    uintptr_t bits = 0;
+};
+
+static_assert(sizeof(ObjectHolder) == sizeof(uintptr_t));
+
+// Kind checks are on the hot path of every operation, so these two are inline
+inline const Object *ObjectHolder::Get() const {
+    return bits & kNumber ? nullptr : Pointee();
+}
+
+inline Kind ObjectHolder::GetKind() const {
+    if (bits & kNumber) {
+        return Kind::Number;
+    }
+    auto object = Get();
+    return object ? object->GetKind() : Kind::None;
+}
+
+// Local variables of a running method, resolved to slot indices before execution.
+// Frames are carved out of big chunks in LIFO order, so entering a method
+// doesn't allocate memory once the chunks are warmed up.
+class Frame {
+ public:
+    explicit Frame(size_t size);
+
+    Frame(const Frame &) = delete;
+
+    Frame(Frame &&other) noexcept
+        : slots(std::exchange(other.slots, nullptr)), size(std::exchange(other.size, 0)) {
+    }
+
+    Frame &operator=(const Frame &) = delete;
+
+    ~Frame();
+
+    ObjectHolder *Slots() const {
+        return slots;
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+    // Makes the frame at least the given size, keeping the values of the slots.
+    // Only the most recent frame can grow, and its slots may move.
+    void Grow(size_t new_size);
+
+    // Unsets the slots from the given one to the end of the frame
+    void Clear(size_t first);
+
+    // Value of a slot whose variable hasn't been assigned yet
+    static bool IsUnset(const ObjectHolder &slot);
+
+ private:
+    ObjectHolder *slots;
+    size_t size;
+};
+
+// Call of a method in the return statement of another one. The returning method leaves it
+// to its caller, which runs it in place of the finished call without going deeper.
+struct TailCall {
+    ObjectHolder object;
+    const Method *method = nullptr;
+    std::vector<ObjectHolder> args;
 };
 
-using Closure = std::unordered_map<std::string, ObjectHolder>;
+// Variables of a scope: names in the map and, inside methods, the slots of a frame.
+// A method call also keeps its return state here: Return stores the result in the
+// closure and enclosing statements stop executing once they see it, so returning
+// from a method doesn't need to unwind the C++ stack.
+class Closure : public std::unordered_map<Symbol, ObjectHolder> {
+ public:
+    using unordered_map::unordered_map;
+
+    explicit Closure(ObjectHolder *frame) : frame(frame) {
+    }
+
+    ObjectHolder &Slot(size_t index) {
+        return frame[index];
+    }
+
+    // Only method calls with a frame run tail calls, the top-level program doesn't
+    bool HasFrame() const {
+        return frame;
+    }
+
+    bool IsReturning() const {
+        return returning;
+    }
+
+    void SetReturnValue(ObjectHolder value) {
+        return_value = std::move(value);
+        returning = true;
+    }
+
+    ObjectHolder TakeReturnValue() {
+        returning = false;
+        return std::move(return_value);
+    }
+
+    void SetTailCall(TailCall call) {
+        tail_call = std::move(call);
+        returning = true;
+    }
+
+    bool HasTailCall() const {
+        return tail_call.method;
+    }
+
+    TailCall TakeTailCall() {
+        returning = false;
+        return std::exchange(tail_call, {});
+    }
+
+ private:
+    ObjectHolder *frame = nullptr;
+    ObjectHolder return_value;
+    TailCall tail_call;
+    bool returning = false;
+};
 
 bool IsTrue(ObjectHolder object);
 
@@ -2,6 +2,7 @@
 #include "object.h"
 #include "test_runner.h"
 
+#include <climits>
 #include <sstream>
 
 
@@ -17,11 +18,11 @@ class Logger : public Object {
         ++instance_count;
     }
 
-    Logger(const Logger &rhs) : id(rhs.id) {
+    Logger(const Logger &rhs) : Object(rhs), id(rhs.id) {
         ++instance_count;
     }
 
-    Logger(Logger &&rhs) : id(rhs.id) {
+    Logger(Logger &&rhs) : Object(rhs), id(rhs.id) {
         ++instance_count;
     }
 
@@ -102,17 +103,103 @@ void TestMove() {
     }
 }
 
+void TestCopiesShareOwnership() {
+    ASSERT_EQUAL(Logger::instance_count, 0);
+    {
+        auto one = ObjectHolder::Own(Logger(5));
+        ObjectHolder two = one;
+        ASSERT(two.Get() == one.Get());
+
+        one = ObjectHolder::None();
+        ASSERT_EQUAL(Logger::instance_count, 1);
+        ASSERT_EQUAL(two.TryAs<Logger>()->GetId(), 5);
+
+        two = two;
+        ASSERT_EQUAL(Logger::instance_count, 1);
+    }
+    ASSERT_EQUAL(Logger::instance_count, 0);
+}
+
+void TestShareOwnedObject() {
+    ASSERT_EQUAL(Logger::instance_count, 0);
+    {
+        auto owner = ObjectHolder::Own(Logger(9));
+        auto shared = ObjectHolder::Share(*owner.Get());
+        ASSERT(shared.Get() == owner.Get());
+
+        owner = ObjectHolder::None();
+        ASSERT_EQUAL(Logger::instance_count, 1);
+        ASSERT_EQUAL(shared.TryAs<Logger>()->GetId(), 9);
+    }
+    ASSERT_EQUAL(Logger::instance_count, 0);
+}
+
 void TestNullptr() {
     ObjectHolder oh;
     ASSERT(!oh);
     ASSERT(!oh.Get());
 }
 
+void TestImmediates() {
+    auto number = ObjectHolder::Own(Number(42));
+    ASSERT(number);
+    ASSERT(number.TryAs<Number>());
+    ASSERT(!number.TryAs<Bool>());
+    ASSERT_EQUAL(number.TryAs<Number>()->GetValue(), 42);
+
+    ASSERT(!number.Get());
+
+    ObjectHolder copy = number;
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42);
+    ASSERT_EQUAL(ObjectHolder::Own(Number(INT_MIN)).TryAs<Number>()->GetValue(), INT_MIN);
+    ASSERT_EQUAL(ObjectHolder::Own(Number(INT_MAX)).TryAs<Number>()->GetValue(), INT_MAX);
+
+    auto flag = ObjectHolder::Own(Bool(true));
+    ASSERT(flag.TryAs<Bool>());
+    ASSERT(flag.Get() == ObjectHolder::Own(Bool(true)).Get());
+    ASSERT(flag.TryAs<ValueObject<bool>>());
+    ASSERT(!flag.TryAs<Number>());
+    ASSERT(IsTrue(flag));
+
+    ostringstream os;
+    number->Print(os);
+    os << ' ';
+    flag->Print(os);
+    ASSERT_EQUAL(os.str(), "42 True");
+
+    Number shared(7);
+    auto oh = ObjectHolder::Share(shared);
+    ASSERT(oh.Get() == &shared);
+    ASSERT(oh.TryAs<Number>() == &shared);
+}
+
+void TestKinds() {
+    ASSERT(ObjectHolder().GetKind() == Kind::None);
+    ASSERT(ObjectHolder::Own(Number(1)).GetKind() == Kind::Number);
+    ASSERT(ObjectHolder::Own(Bool(false)).GetKind() == Kind::Bool);
+    ASSERT(ObjectHolder::Own(String("s")).GetKind() == Kind::String);
+
+    auto logger = ObjectHolder::Own(Logger(5));
+    ASSERT(logger.GetKind() == Kind::Other);
+    ASSERT(logger.TryAs<Logger>());
+    ASSERT(!logger.TryAs<String>());
+    ASSERT(logger.TryAs<Object>() == logger.Get());
+
+    Bool flag(true);
+    auto shared_flag = ObjectHolder::Share(flag);
+    ASSERT(shared_flag.GetKind() == Kind::Bool);
+    ASSERT(shared_flag.TryAs<Bool>() == &flag);
+}
+
 void RunObjectHolderTests(TestRunner &tr) {
     RUN_TEST(tr, Runtime::TestNonowning);
     RUN_TEST(tr, Runtime::TestOwning);
     RUN_TEST(tr, Runtime::TestMove);
+    RUN_TEST(tr, Runtime::TestCopiesShareOwnership);
+    RUN_TEST(tr, Runtime::TestShareOwnedObject);
     RUN_TEST(tr, Runtime::TestNullptr);
+    RUN_TEST(tr, Runtime::TestImmediates);
+    RUN_TEST(tr, Runtime::TestKinds);
 }
 
 } /* namespace Runtime */
@@ -38,7 +38,7 @@ void TestFields() {
         }
                       });
     methods.push_back({
-                          "value", {}, {make_unique<Ast::VariableValue>(vector<string>{"self", "value"})}
+                          "value", {}, {make_unique<Ast::VariableValue>(vector<Symbol>{"self", "value"})}
                       });
     methods.push_back({
                           "add",
@@ -47,7 +47,7 @@ void TestFields() {
                               make_unique<Ast::FieldAssignment>(
                                   Ast::VariableValue{"self"},
                                   "value", make_unique<Ast::Add>(
-                                      make_unique<Ast::VariableValue>(vector<string>{"self", "value"}),
+                                      make_unique<Ast::VariableValue>(vector<Symbol>{"self", "value"}),
                                       make_unique<Ast::VariableValue>("x")
                                   )
                               )
@@ -72,7 +72,7 @@ void TestFields() {
 void TestBaseClass() {
     vector<Method> methods;
     methods.push_back({
-                          "GetValue", {}, make_unique<Ast::VariableValue>(vector{"self"s, "value"s})
+                          "GetValue", {}, make_unique<Ast::VariableValue>(vector<Symbol>{"self", "value"})
                       });
     methods.push_back({
                           "SetValue", {"x"}, make_unique<Ast::FieldAssignment>(
@@ -101,7 +101,7 @@ void TestBaseClass() {
 void TestInheritance() {
     vector<Method> methods;
     methods.push_back({
-                          "GetValue", {}, make_unique<Ast::VariableValue>(vector{"self"s, "value"s})
+                          "GetValue", {}, make_unique<Ast::VariableValue>(vector<Symbol>{"self", "value"})
                       });
     methods.push_back({
                           "SetValue", {"x"}, make_unique<Ast::FieldAssignment>(
@@ -142,12 +142,137 @@ void TestInheritance() {
     ASSERT(!cls.GetMethod("AsStringValue"));
 }
 
+void TestDeepInheritance() {
+    vector<unique_ptr<Class>> hierarchy;
+    for (int i = 0; i < 20; ++i) {
+        vector<Method> methods;
+        methods.push_back({"level", {}, make_unique<Ast::NumericConst>(i)});
+        if (i % 5 == 0) {
+            methods.push_back({"level" + to_string(i), {"x"}, make_unique<Ast::NumericConst>(i)});
+        }
+        const Class *parent = hierarchy.empty() ? nullptr : hierarchy.back().get();
+        hierarchy.push_back(make_unique<Class>("Level" + to_string(i), std::move(methods), parent));
+    }
+
+    const Class &leaf = *hierarchy.back();
+    ASSERT(leaf.GetMethod("level") == hierarchy.back()->GetMethod(hierarchy.back()->GetMethods()[0].name));
+    for (int i = 0; i < 20; i += 5) {
+        auto m = leaf.GetMethod("level" + to_string(i));
+        ASSERT(m);
+        ASSERT(m == hierarchy[i]->GetMethod("level" + to_string(i)));
+        ASSERT(!hierarchy[i]->GetMethod("level" + to_string(i + 5)));
+    }
+
+    ClassInstance instance(leaf);
+    ASSERT(instance.HasMethod("level0", 1));
+    ASSERT(!instance.HasMethod("level0", 0));
+    ASSERT(!instance.HasMethod("level1", 0));
+    ASSERT_EQUAL(instance.Call("level", {}).TryAs<Number>()->GetValue(), 19);
+
+    vector<Method> duplicates;
+    duplicates.push_back({"twice", {}, make_unique<Ast::NumericConst>(1)});
+    duplicates.push_back({"twice", {}, make_unique<Ast::NumericConst>(2)});
+    ASSERT_THROWS(Class("Duplicates", std::move(duplicates), &leaf), std::runtime_error);
+}
+
+void TestManyClasses() {
+    // Every class has a method nobody else has, the tables must not grow with the program
+    vector<unique_ptr<Class>> classes;
+    for (int i = 0; i < 2000; ++i) {
+        vector<Method> methods;
+        methods.push_back({"method" + to_string(i), {}, make_unique<Ast::NumericConst>(i)});
+        classes.push_back(make_unique<Class>("Class" + to_string(i), std::move(methods), nullptr));
+    }
+    for (int i = 0; i < 2000; i += 199) {
+        ASSERT_EQUAL(classes[i]->MethodCount(), 1u);
+        ASSERT(classes[i]->GetMethod("method" + to_string(i)));
+        ASSERT(!classes[i]->GetMethod("method" + to_string(i + 1)));
+    }
+
+    vector<Method> methods;
+    methods.push_back({"method0", {}, make_unique<Ast::NumericConst>(-1)});
+    Class derived("Derived", std::move(methods), classes.back().get());
+    ASSERT_EQUAL(derived.MethodCount(), 2u);
+    ASSERT(derived.GetMethod("method1999") == classes.back()->GetMethod("method1999"));
+    ASSERT(derived.GetMethod("method0") != classes[0]->GetMethod("method0"));
+}
+
+void TestSpecialMethodSlots() {
+    using SpecialMethod::Slot;
+
+    vector<Method> base_methods;
+    base_methods.push_back({"__init__", {"a", "b"}, make_unique<Ast::NumericConst>(0)});
+    base_methods.push_back({"__str__", {}, make_unique<Ast::StringConst>(String("base"))});
+    base_methods.push_back({"__lt__", {}, make_unique<Ast::BoolConst>(Bool(true))});
+    Class base("Base", std::move(base_methods), nullptr);
+
+    ASSERT(base.GetMethod(Slot::Init) == base.GetMethod("__init__"));
+    ASSERT(base.GetMethod(Slot::Str) == base.GetMethod("__str__"));
+    // Takes no argument, so it can't be called as an operator
+    ASSERT(!base.GetMethod(Slot::Lt));
+    ASSERT(!base.GetMethod(Slot::Eq));
+
+    vector<Method> derived_methods;
+    derived_methods.push_back({"__eq__", {"other"}, make_unique<Ast::BoolConst>(Bool(false))});
+    Class derived("Derived", std::move(derived_methods), &base);
+
+    ASSERT(derived.GetMethod(Slot::Str) == base.GetMethod(Slot::Str));
+    ASSERT(derived.GetMethod(Slot::Eq) == derived.GetMethod("__eq__"));
+
+    ostringstream os;
+    ClassInstance(derived).Print(os);
+    ASSERT_EQUAL(os.str(), "base");
+}
+
+void TestShapes() {
+    Class cls("Point", {}, nullptr);
+    ClassInstance a(cls), b(cls), c(cls);
+
+    ASSERT(a.GetShape() == cls.GetRootShape());
+
+    a.SetField("x", ObjectHolder::Own(Number(1)));
+    a.SetField("y", ObjectHolder::Own(Number(2)));
+    b.SetField("x", ObjectHolder::Own(Number(3)));
+    b.SetField("y", ObjectHolder::Own(Number(4)));
+    c.SetField("y", ObjectHolder::Own(Number(5)));
+    c.SetField("x", ObjectHolder::Own(Number(6)));
+
+    ASSERT(a.GetShape() == b.GetShape());
+    ASSERT(a.GetShape() != c.GetShape());
+    ASSERT_EQUAL(a.GetShape()->FieldCount(), 2u);
+    ASSERT_EQUAL(cls.GetRootShape()->ExpectedFieldCount(), 2u);
+
+    a.SetField("x", ObjectHolder::Own(Number(7)));
+    ASSERT(a.GetShape() == b.GetShape());
+
+    FieldCache cache;
+    vector<pair<ClassInstance *, int>> expected = {{&a, 7}, {&b, 3}, {&c, 6}, {&a, 7}};
+    for (auto[instance, x] : expected) {
+        auto *field = instance->FindField("x", cache);
+        ASSERT(field);
+        ASSERT_EQUAL(field->TryAs<Number>()->GetValue(), x);
+    }
+    ASSERT(!a.FindField("z"));
+
+    ClassInstance d(cls);
+    FieldCache set_cache;
+    d.SetField("x", ObjectHolder::Own(Number(0)), set_cache);
+    ClassInstance e(cls);
+    e.SetField("x", ObjectHolder::Own(Number(1)), set_cache);
+    ASSERT(d.GetShape() == e.GetShape());
+    ASSERT_EQUAL(e.FindField("x")->TryAs<Number>()->GetValue(), 1);
+}
+
 void RunObjectsTests(TestRunner &tr) {
     RUN_TEST(tr, Runtime::TestNumber);
     RUN_TEST(tr, Runtime::TestString);
     RUN_TEST(tr, Runtime::TestFields);
     RUN_TEST(tr, Runtime::TestBaseClass);
     RUN_TEST(tr, Runtime::TestInheritance);
+    RUN_TEST(tr, Runtime::TestDeepInheritance);
+    RUN_TEST(tr, Runtime::TestManyClasses);
+    RUN_TEST(tr, Runtime::TestSpecialMethodSlots);
+    RUN_TEST(tr, Runtime::TestShapes);
 }
 
 } /* namespace Runtime */
@@ -0,0 +1,207 @@
+#include "optimize.h"
+#include "statement.h"
+
+#include <stdexcept>
+
+
+using namespace std;
+
+namespace Ast {
+
+namespace {
+
+bool IsConstant(const Statement &statement) {
+    return dynamic_cast<const NumericConst *>(&statement)
+        || dynamic_cast<const StringConst *>(&statement)
+        || dynamic_cast<const BoolConst *>(&statement)
+        || dynamic_cast<const None *>(&statement);
+}
+
+unique_ptr<Statement> MakeConstant(const ObjectHolder &value) {
+    using Runtime::Kind;
+    switch (value.GetKind()) {
+        case Kind::None:
+            return make_unique<None>();
+        case Kind::Number:
+            return make_unique<NumericConst>(*value.TryAs<Runtime::Number>());
+        case Kind::String:
+            return make_unique<StringConst>(*value.TryAs<Runtime::String>());
+        case Kind::Bool:
+            return make_unique<BoolConst>(*value.TryAs<Runtime::Bool>());
+        default:
+            return nullptr;
+    }
+}
+
+// Value of a constant node, it doesn't depend on the closure
+ObjectHolder ConstantValue(Statement &statement) {
+    Runtime::Closure closure;
+    return statement.Execute(closure);
+}
+
+class Optimizer : public Visitor {
+ public:
+    using Visitor::Visit;
+
+    void Optimize(unique_ptr<Statement> &statement) {
+        statement->Accept(*this);
+        if (replacement) {
+            statement = std::move(replacement);
+        }
+    }
+
+    void Visit(Assignment &node) override {
+        Optimize(node.right_value);
+    }
+
+    void Visit(FieldAssignment &node) override {
+        Optimize(node.right_value);
+    }
+
+    void Visit(Print &node) override {
+        OptimizeAll(node.args);
+    }
+
+    void Visit(MethodCall &node) override {
+        OptimizeAll(node.args);
+        Optimize(node.object);
+    }
+
+    void Visit(NewInstance &node) override {
+        OptimizeAll(node.args);
+    }
+
+    void Visit(Stringify &node) override {
+        FoldUnary(node);
+    }
+
+    void Visit(Add &node) override {
+        FoldBinary(node);
+    }
+
+    void Visit(Sub &node) override {
+        FoldBinary(node);
+    }
+
+    void Visit(Mult &node) override {
+        FoldBinary(node);
+    }
+
+    void Visit(Div &node) override {
+        FoldBinary(node);
+    }
+
+    void Visit(Or &node) override {
+        FoldLogical(node, true);
+    }
+
+    void Visit(And &node) override {
+        FoldLogical(node, false);
+    }
+
+    void Visit(Not &node) override {
+        FoldUnary(node);
+    }
+
+    void Visit(Negate &node) override {
+        FoldUnary(node);
+    }
+
+    void Visit(Compound &node) override {
+        OptimizeAll(node.statements);
+    }
+
+    void Visit(Return &node) override {
+        Optimize(node.statement);
+    }
+
+    void Visit(IfElse &node) override {
+        Optimize(node.condition);
+        Optimize(node.if_body);
+        if (node.else_body) {
+            Optimize(node.else_body);
+        }
+
+        if (IsConstant(*node.condition)) {
+            if (IsTrue(ConstantValue(*node.condition))) {
+                replacement = std::move(node.if_body);
+            } else if (node.else_body) {
+                replacement = std::move(node.else_body);
+            } else {
+                replacement = make_unique<None>();
+            }
+        }
+    }
+
+    void Visit(While &node) override {
+        Optimize(node.condition);
+        Optimize(node.body);
+
+        if (IsConstant(*node.condition) && !IsTrue(ConstantValue(*node.condition))) {
+            replacement = make_unique<None>();
+        }
+    }
+
+    void Visit(Comparison &node) override {
+        Optimize(node.left);
+        Optimize(node.right);
+        if (IsConstant(*node.left) && IsConstant(*node.right)) {
+            Fold(node);
+        }
+    }
+
+ private:
+    unique_ptr<Statement> replacement;
+
+    void OptimizeAll(vector<unique_ptr<Statement>> &statements) {
+        for (auto &statement : statements) {
+            Optimize(statement);
+        }
+    }
+
+    void FoldUnary(UnaryOperation &node) {
+        Optimize(node.argument);
+        if (IsConstant(*node.argument)) {
+            Fold(node);
+        }
+    }
+
+    void FoldBinary(BinaryOperation &node) {
+        Optimize(node.lhs);
+        Optimize(node.rhs);
+        if (IsConstant(*node.lhs) && IsConstant(*node.rhs)) {
+            Fold(node);
+        }
+    }
+
+    // A constant left side either decides the result or leaves just the right side to check
+    void FoldLogical(BinaryOperation &node, bool deciding_value) {
+        Optimize(node.lhs);
+        Optimize(node.rhs);
+        if (!IsConstant(*node.lhs)) {
+            return;
+        }
+
+        if (IsTrue(ConstantValue(*node.lhs)) == deciding_value) {
+            replacement = make_unique<BoolConst>(Runtime::Bool(deciding_value));
+        } else if (IsConstant(*node.rhs)) {
+            Fold(node);
+        }
+    }
+
+    // Operands of the node are constants, so is its value, unless the operation fails
+    void Fold(Statement &node) {
+        try {
+            replacement = MakeConstant(ConstantValue(node));
+        } catch (const runtime_error &) {
+        }
+    }
+};
+
+}
+
+void Optimize(unique_ptr<Statement> &statement) {
+    Optimizer().Optimize(statement);
+}
+
+}
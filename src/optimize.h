@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+
+
+class TestRunner;
+
+namespace Ast {
+
+class Statement;
+
+// Rewrites the tree in place: evaluates operations on constants, drops branches of
+// ifs with a constant condition and short-circuits and/or with a constant left side.
+// Operations that fail on their constants, like division by zero, are left to fail at run time.
+void Optimize(std::unique_ptr<Statement> &statement);
+
+void RunOptimizerTests(TestRunner &tr);
+
+}
@@ -0,0 +1,128 @@
+#include "optimize.h"
+#include "statement.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner.h"
+
+#include <sstream>
+#include <string>
+
+
+using namespace std;
+
+namespace Ast {
+
+namespace {
+
+unique_ptr<Statement> Parse(const string &program) {
+    istringstream input(program);
+    Parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+Statement &FirstStatement(unique_ptr<Statement> &program) {
+    return *dynamic_cast<Compound &>(*program).statements.front();
+}
+
+Statement &AssignedValue(unique_ptr<Statement> &program) {
+    return *dynamic_cast<Assignment &>(FirstStatement(program)).right_value;
+}
+
+int AssignedNumber(unique_ptr<Statement> &program) {
+    return dynamic_cast<NumericConst &>(AssignedValue(program)).value.GetValue();
+}
+
+}
+
+void TestFoldConstants() {
+    auto program = Parse("x = 2*5+10/2");
+    ASSERT_EQUAL(AssignedNumber(program), 15);
+
+    program = Parse("x = -8");
+    ASSERT_EQUAL(AssignedNumber(program), -8);
+
+    program = Parse("x = 'a' + str(1 < 2)");
+    ASSERT_EQUAL(dynamic_cast<StringConst &>(AssignedValue(program)).value.GetValue(), "aTrue");
+
+    program = Parse("x = str(None) + '!'");
+    ASSERT_EQUAL(dynamic_cast<StringConst &>(AssignedValue(program)).value.GetValue(), "None!");
+
+    // Folded even where it never runs
+    program = Parse("x = 1\nif False:\n  print str(None)\nprint x");
+    ostringstream output;
+    Print::SetOutputStream(output);
+    Runtime::Closure closure;
+    program->Execute(closure);
+    ASSERT_EQUAL(output.str(), "1\n");
+
+    program = Parse("x = False or not None");
+    ASSERT(dynamic_cast<BoolConst &>(AssignedValue(program)).value.GetValue());
+
+    // The right side is never evaluated, so its variable may even be missing
+    program = Parse("x = True or y");
+    ASSERT(dynamic_cast<BoolConst &>(AssignedValue(program)).value.GetValue());
+
+    program = Parse("x = y + 2 * 3");
+    auto &sum = dynamic_cast<Add &>(AssignedValue(program));
+    ASSERT_EQUAL(dynamic_cast<NumericConst &>(*sum.rhs).value.GetValue(), 6);
+}
+
+void TestKeepFailingOperations() {
+    auto program = Parse("x = 1 + 1 / 0");
+    ASSERT(dynamic_cast<Add *>(&AssignedValue(program)));
+
+    Runtime::Closure closure;
+    string error;
+    try {
+        program->Execute(closure);
+    } catch (const runtime_error &e) {
+        error = e.what();
+    }
+    ASSERT_EQUAL(error, "Division by zero");
+
+    program = Parse("x = -'a'");
+    ASSERT(dynamic_cast<Negate *>(&AssignedValue(program)));
+}
+
+void TestNegate() {
+    auto program = Parse("x = 5\ny = -x\nprint y, --x, -(x - 7)");
+    ASSERT(dynamic_cast<Negate *>(dynamic_cast<Assignment &>(
+        *dynamic_cast<Compound &>(*program).statements[1]).right_value.get()));
+
+    ostringstream output;
+    Print::SetOutputStream(output);
+    Runtime::Closure closure;
+    program->Execute(closure);
+    ASSERT_EQUAL(output.str(), "-5 5 2\n");
+}
+
+void TestPruneConstantBranches() {
+    auto program = Parse(R"(
+if 1 < 2:
+  print 'yes'
+else:
+  print 'no'
+)");
+    ASSERT(!dynamic_cast<IfElse *>(&FirstStatement(program)));
+
+    ostringstream output;
+    Print::SetOutputStream(output);
+    Runtime::Closure closure;
+    program->Execute(closure);
+    ASSERT_EQUAL(output.str(), "yes\n");
+
+    program = Parse("if 'a' == 'b':\n  print 'never'\n");
+    ASSERT(dynamic_cast<None *>(&FirstStatement(program)));
+
+    program = Parse("while 1 > 2:\n  print 'never'\n");
+    ASSERT(dynamic_cast<None *>(&FirstStatement(program)));
+}
+
+void RunOptimizerTests(TestRunner &tr) {
+    RUN_TEST(tr, Ast::TestFoldConstants);
+    RUN_TEST(tr, Ast::TestKeepFailingOperations);
+    RUN_TEST(tr, Ast::TestNegate);
+    RUN_TEST(tr, Ast::TestPruneConstantBranches);
+}
+
+}
@@ -1,7 +1,9 @@
 #include "parse.h"
 #include "statement.h"
 #include "lexer.h"
-#include "comparators.h"
+#include "token_pipe.h"
+#include "optimize.h"
+#include "resolve.h"
 
 #include <algorithm>
 #include <string>
@@ -15,6 +17,8 @@ using namespace std;
 namespace TokenType = Parse::TokenType;
 
 namespace {
+const Symbol StrFunction = "str";
+
 bool operator==(const Parse::Token &token, char c) {
     auto p = token.TryAs<TokenType::Char>();
     return p && p->value == c;
@@ -28,38 +32,40 @@ bool operator!=(const Parse::Token &token, char c) {
 
 class Parser {
  public:
-    explicit Parser(Parse::Lexer &lexer) : lexer(lexer) {
+    explicit Parser(Parse::TokenCursor &tokens) : tokens(tokens) {
     }
 
     // Program -> eps
     //          | Statement \n Program
     unique_ptr<Ast::Statement> ParseProgram() {
-        auto result = make_unique<Ast::Compound>();
-        while (!lexer.CurrentToken().Is<TokenType::Eof>()) {
-            result->AddStatement(ParseStatement());
+        auto program = make_unique<Ast::Compound>();
+        while (!tokens.CurrentToken().Is<TokenType::Eof>()) {
+            program->AddStatement(ParseStatement());
         }
 
+        unique_ptr<Ast::Statement> result = std::move(program);
+        Ast::Optimize(result);
         return result;
     }
 
  private:
-    Parse::Lexer &lexer;
+    Parse::TokenCursor &tokens;
     Runtime::Closure declared_classes;
 
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<Ast::Statement> ParseSuite() {
-        lexer.Expect<TokenType::Newline>();
-        lexer.ExpectNext<TokenType::Indent>();
+        tokens.Expect<TokenType::Newline>();
+        tokens.ExpectNext<TokenType::Indent>();
 
-        lexer.NextToken();
+        tokens.NextToken();
 
         auto result = make_unique<Ast::Compound>();
-        while (!lexer.CurrentToken().Is<TokenType::Dedent>()) {
+        while (!tokens.CurrentToken().Is<TokenType::Dedent>()) {
             result->AddStatement(ParseStatement());
         }
 
-        lexer.Expect<TokenType::Dedent>();
-        lexer.NextToken();
+        tokens.Expect<TokenType::Dedent>();
+        tokens.NextToken();
 
         return result;
     }
@@ -68,24 +74,26 @@ class Parser {
     vector<Runtime::Method> ParseMethods() {
         vector<Runtime::Method> result;
 
-        while (lexer.CurrentToken().Is<TokenType::Def>()) {
+        while (tokens.CurrentToken().Is<TokenType::Def>()) {
             Runtime::Method m;
 
-            m.name = lexer.ExpectNext<TokenType::Id>().value;
-            lexer.ExpectNext<TokenType::Char>('(');
+            m.name = tokens.ExpectNext<TokenType::Id>().value;
+            tokens.ExpectNext<TokenType::Char>('(');
 
-            if (lexer.NextToken().Is<TokenType::Id>()) {
-                m.formal_params.push_back(lexer.Expect<TokenType::Id>().value);
-                while (lexer.NextToken() == ',') {
-                    m.formal_params.push_back(lexer.ExpectNext<TokenType::Id>().value);
+            if (tokens.NextToken().Is<TokenType::Id>()) {
+                m.formal_params.push_back(tokens.Expect<TokenType::Id>().value);
+                while (tokens.NextToken() == ',') {
+                    m.formal_params.push_back(tokens.ExpectNext<TokenType::Id>().value);
                 }
             }
 
-            lexer.Expect<TokenType::Char>(')');
-            lexer.ExpectNext<TokenType::Char>(':');
-            lexer.NextToken();
+            tokens.Expect<TokenType::Char>(')');
+            tokens.ExpectNext<TokenType::Char>(':');
+            tokens.NextToken();
 
             m.body = ParseSuite();
+            Ast::Optimize(m.body);
+            Ast::ResolveLocals(m);
 
             result.push_back(std::move(m));
         }
@@ -94,31 +102,31 @@ class Parser {
 
     // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
     unique_ptr<Ast::Statement> ParseClassDefinition() {
-        string class_name = lexer.Expect<TokenType::Id>().value;
+        Symbol class_name = tokens.Expect<TokenType::Id>().value;
 
-        lexer.NextToken();
+        tokens.NextToken();
 
         const Runtime::Class *base_class = nullptr;
-        if (lexer.CurrentToken() == '(') {
-            auto name = lexer.ExpectNext<TokenType::Id>().value;
-            lexer.ExpectNext<TokenType::Char>(')');
-            lexer.NextToken();
+        if (tokens.CurrentToken() == '(') {
+            auto name = tokens.ExpectNext<TokenType::Id>().value;
+            tokens.ExpectNext<TokenType::Char>(')');
+            tokens.NextToken();
 
             if (auto it = declared_classes.find(name); it == declared_classes.end()) {
-                throw ParseError("Base class " + name + " not found for class " + class_name);
+                throw ParseError("Base class " + name.Name() + " not found for class " + class_name.Name());
             } else {
                 base_class = static_cast<const Runtime::Class *>(it->second.Get());
             }
         }
 
-        lexer.Expect<TokenType::Char>(':');
-        lexer.ExpectNext<TokenType::Newline>();
-        lexer.ExpectNext<TokenType::Indent>();
-        lexer.ExpectNext<TokenType::Def>();
+        tokens.Expect<TokenType::Char>(':');
+        tokens.ExpectNext<TokenType::Newline>();
+        tokens.ExpectNext<TokenType::Indent>();
+        tokens.ExpectNext<TokenType::Def>();
         vector<Runtime::Method> methods = ParseMethods();
 
-        lexer.Expect<TokenType::Dedent>();
-        lexer.NextToken();
+        tokens.Expect<TokenType::Dedent>();
+        tokens.NextToken();
 
         auto[it, inserted] = declared_classes.insert({
                                                          class_name,
@@ -127,17 +135,17 @@ class Parser {
                                                      });
 
         if (!inserted) {
-            throw ParseError("Class " + class_name + " already exists");
+            throw ParseError("Class " + class_name.Name() + " already exists");
         }
 
         return make_unique<Ast::ClassDefinition>(it->second);
     }
 
-    vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer.Expect<TokenType::Id>().value);
+    vector<Symbol> ParseDottedIds() {
+        vector<Symbol> result(1, tokens.Expect<TokenType::Id>().value);
 
-        while (lexer.NextToken() == '.') {
-            result.push_back(lexer.ExpectNext<TokenType::Id>().value);
+        while (tokens.NextToken() == '.') {
+            result.push_back(tokens.ExpectNext<TokenType::Id>().value);
         }
 
         return result;
@@ -146,14 +154,14 @@ class Parser {
     //  AssgnOrCall -> DottedIds = Expr
     //               | DottedIds '(' ExprList ')'
     unique_ptr<Ast::Statement> ParseAssignmentOrCall() {
-        lexer.Expect<TokenType::Id>();
+        tokens.Expect<TokenType::Id>();
 
-        vector<string> id_list = ParseDottedIds();
-        string last_name = id_list.back();
+        vector<Symbol> id_list = ParseDottedIds();
+        Symbol last_name = id_list.back();
         id_list.pop_back();
 
-        if (lexer.CurrentToken() == '=') {
-            lexer.NextToken();
+        if (tokens.CurrentToken() == '=') {
+            tokens.NextToken();
 
             if (id_list.empty()) {
                 return make_unique<Ast::Assignment>(std::move(last_name), ParseTest());
@@ -163,20 +171,20 @@ class Parser {
                 );
             }
         } else {
-            lexer.Expect<TokenType::Char>('(');
-            lexer.NextToken();
+            tokens.Expect<TokenType::Char>('(');
+            tokens.NextToken();
 
             if (id_list.empty()) {
-                throw ParseError("Sithon doesn't support functions, only methods: " + last_name);
+                throw ParseError("Sithon doesn't support functions, only methods: " + last_name.Name());
             }
 
 
             vector<unique_ptr<Ast::Statement>> args;
-            if (lexer.CurrentToken() != ')') {
+            if (tokens.CurrentToken() != ')') {
                 args = ParseTestList();
             }
-            lexer.Expect<TokenType::Char>(')');
-            lexer.NextToken();
+            tokens.Expect<TokenType::Char>(')');
+            tokens.NextToken();
 
             return make_unique<Ast::MethodCall>(
                 make_unique<Ast::VariableValue>(std::move(id_list)),
@@ -189,9 +197,9 @@ class Parser {
     // Expr -> Adder ['+'/'-' Adder]*
     unique_ptr<Ast::Statement> ParseExpression() {
         unique_ptr<Ast::Statement> result = ParseAdder();
-        while (lexer.CurrentToken() == '+' || lexer.CurrentToken() == '-') {
-            char op = lexer.CurrentToken().As<TokenType::Char>().value;
-            lexer.NextToken();
+        while (tokens.CurrentToken() == '+' || tokens.CurrentToken() == '-') {
+            char op = tokens.CurrentToken().As<TokenType::Char>().value;
+            tokens.NextToken();
 
             if (op == '+') {
                 result = make_unique<Ast::Add>(std::move(result), ParseAdder());
@@ -205,9 +213,9 @@ class Parser {
     // Adder -> Mult ['*'/'/' Mult]*
     unique_ptr<Ast::Statement> ParseAdder() {
         unique_ptr<Ast::Statement> result = ParseMult();
-        while (lexer.CurrentToken() == '*' || lexer.CurrentToken() == '/') {
-            char op = lexer.CurrentToken().As<TokenType::Char>().value;
-            lexer.NextToken();
+        while (tokens.CurrentToken() == '*' || tokens.CurrentToken() == '/') {
+            char op = tokens.CurrentToken().As<TokenType::Char>().value;
+            tokens.NextToken();
 
             if (op == '*') {
                 result = make_unique<Ast::Mult>(std::move(result), ParseMult());
@@ -228,46 +236,43 @@ class Parser {
     //       | DottedIds '(' ExprList ')'
     //       | DottedIds
     unique_ptr<Ast::Statement> ParseMult() {
-        if (lexer.CurrentToken() == '(') {
-            lexer.NextToken();
+        if (tokens.CurrentToken() == '(') {
+            tokens.NextToken();
             auto result = ParseTest();
-            lexer.Expect<TokenType::Char>(')');
-            lexer.NextToken();
+            tokens.Expect<TokenType::Char>(')');
+            tokens.NextToken();
             return result;
-        } else if (lexer.CurrentToken() == '-') {
-            lexer.NextToken();
-            return make_unique<Ast::Mult>(
-                ParseMult(),
-                make_unique<Ast::NumericConst>(-1)
-            );
-        } else if (auto num = lexer.CurrentToken().TryAs<TokenType::Number>()) {
+        } else if (tokens.CurrentToken() == '-') {
+            tokens.NextToken();
+            return make_unique<Ast::Negate>(ParseMult());
+        } else if (auto num = tokens.CurrentToken().TryAs<TokenType::Number>()) {
             int result = num->value;
-            lexer.NextToken();
+            tokens.NextToken();
             return make_unique<Ast::NumericConst>(result);
-        } else if (auto str = lexer.CurrentToken().TryAs<TokenType::String>()) {
-            string result = str->value;
-            lexer.NextToken();
+        } else if (auto str = tokens.CurrentToken().TryAs<TokenType::String>()) {
+            string result(str->value);
+            tokens.NextToken();
             return make_unique<Ast::StringConst>(std::move(result));
-        } else if (lexer.CurrentToken().Is<TokenType::True>()) {
-            lexer.NextToken();
+        } else if (tokens.CurrentToken().Is<TokenType::True>()) {
+            tokens.NextToken();
             return make_unique<Ast::BoolConst>(Runtime::Bool(true));
-        } else if (lexer.CurrentToken().Is<TokenType::False>()) {
-            lexer.NextToken();
+        } else if (tokens.CurrentToken().Is<TokenType::False>()) {
+            tokens.NextToken();
             return make_unique<Ast::BoolConst>(Runtime::Bool(false));
-        } else if (lexer.CurrentToken().Is<TokenType::None>()) {
-            lexer.NextToken();
+        } else if (tokens.CurrentToken().Is<TokenType::None>()) {
+            tokens.NextToken();
             return make_unique<Ast::None>();
         } else {
-            vector<string> names = ParseDottedIds();
+            vector<Symbol> names = ParseDottedIds();
 
-            if (lexer.CurrentToken() == '(') {
+            if (tokens.CurrentToken() == '(') {
                 // various calls
                 vector<unique_ptr<Ast::Statement>> args;
-                if (lexer.NextToken() != ')') {
+                if (tokens.NextToken() != ')') {
                     args = ParseTestList();
                 }
-                lexer.Expect<TokenType::Char>(')');
-                lexer.NextToken();
+                tokens.Expect<TokenType::Char>(')');
+                tokens.NextToken();
 
                 auto method_name = names.back();
                 names.pop_back();
@@ -280,15 +285,15 @@ class Parser {
                     );
                 } else if (auto it = declared_classes.find(method_name); it != end(declared_classes)) {
                     return make_unique<Ast::NewInstance>(
-                        static_cast<const Runtime::Class &>(*it->second), std::move(args)
+                        static_cast<const Runtime::Class &>(*it->second.Get()), std::move(args)
                     );
-                } else if (method_name == "str") {
+                } else if (method_name == StrFunction) {
                     if (args.size() != 1) {
                         throw ParseError("Function str takes exactly one argument");
                     }
                     return make_unique<Ast::Stringify>(std::move(args.front()));
                 } else {
-                    throw ParseError("Unknown call to " + method_name + "()");
+                    throw ParseError("Unknown call to " + method_name.Name() + "()");
                 }
             } else {
                 return make_unique<Ast::VariableValue>(std::move(names));
@@ -300,8 +305,8 @@ class Parser {
         vector<unique_ptr<Ast::Statement>> result;
         result.push_back(ParseTest());
 
-        while (lexer.CurrentToken() == ',') {
-            lexer.NextToken();
+        while (tokens.CurrentToken() == ',') {
+            tokens.NextToken();
             result.push_back(ParseTest());
         }
         return result;
@@ -309,34 +314,47 @@ class Parser {
 
     // Condition -> if LogicalExpr: Suite [else: Suite]
     unique_ptr<Ast::Statement> ParseCondition() {
-        lexer.Expect<TokenType::If>();
-        lexer.NextToken();
+        tokens.Expect<TokenType::If>();
+        tokens.NextToken();
 
         auto condition = ParseTest();
 
-        lexer.Expect<TokenType::Char>(':');
-        lexer.NextToken();
+        tokens.Expect<TokenType::Char>(':');
+        tokens.NextToken();
 
         auto if_body = ParseSuite();
 
         unique_ptr<Ast::Statement> else_body;
-        if (lexer.CurrentToken().Is<TokenType::Else>()) {
-            lexer.ExpectNext<TokenType::Char>(':');
-            lexer.NextToken();
+        if (tokens.CurrentToken().Is<TokenType::Else>()) {
+            tokens.ExpectNext<TokenType::Char>(':');
+            tokens.NextToken();
             else_body = ParseSuite();
         }
 
         return make_unique<Ast::IfElse>(std::move(condition), std::move(if_body), std::move(else_body));
     }
 
+    // Loop -> while LogicalExpr: Suite
+    unique_ptr<Ast::Statement> ParseLoop() {
+        tokens.Expect<TokenType::While>();
+        tokens.NextToken();
+
+        auto condition = ParseTest();
+
+        tokens.Expect<TokenType::Char>(':');
+        tokens.NextToken();
+
+        return make_unique<Ast::While>(std::move(condition), ParseSuite());
+    }
+
     // LogicalExpr -> AndTest [OR AndTest]
     // AndTest -> NotTest [AND NotTest]
     // NotTest -> [NOT] NotTest
     //          | Comparison
     unique_ptr<Ast::Statement> ParseTest() {
         auto result = ParseAndTest();
-        while (lexer.CurrentToken().Is<TokenType::Or>()) {
-            lexer.NextToken();
+        while (tokens.CurrentToken().Is<TokenType::Or>()) {
+            tokens.NextToken();
             result = make_unique<Ast::Or>(std::move(result), ParseAndTest());
         }
         return result;
@@ -344,16 +362,16 @@ class Parser {
 
     unique_ptr<Ast::Statement> ParseAndTest() {
         auto result = ParseNotTest();
-        while (lexer.CurrentToken().Is<TokenType::And>()) {
-            lexer.NextToken();
+        while (tokens.CurrentToken().Is<TokenType::And>()) {
+            tokens.NextToken();
             result = make_unique<Ast::And>(std::move(result), ParseNotTest());
         }
         return result;
     }
 
     unique_ptr<Ast::Statement> ParseNotTest() {
-        if (lexer.CurrentToken().Is<TokenType::Not>()) {
-            lexer.NextToken();
+        if (tokens.CurrentToken().Is<TokenType::Not>()) {
+            tokens.NextToken();
             return make_unique<Ast::Not>(ParseNotTest());
         } else {
             return ParseComparison();
@@ -364,26 +382,26 @@ class Parser {
     unique_ptr<Ast::Statement> ParseComparison() {
         auto result = ParseExpression();
 
-        const auto tok = lexer.CurrentToken();
+        const auto tok = tokens.CurrentToken();
 
         if (tok == '<') {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::Less, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::Less>>(std::move(result), ParseExpression());
         } else if (tok == '>') {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::Greater, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::Greater>>(std::move(result), ParseExpression());
         } else if (tok.Is<TokenType::Eq>()) {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::Equal, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::Equal>>(std::move(result), ParseExpression());
         } else if (tok.Is<TokenType::NotEq>()) {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::NotEqual, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::NotEqual>>(std::move(result), ParseExpression());
         } else if (tok.Is<TokenType::LessOrEq>()) {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::LessOrEqual, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::LessOrEqual>>(std::move(result), ParseExpression());
         } else if (tok.Is<TokenType::GreaterOrEq>()) {
-            lexer.NextToken();
-            return make_unique<Ast::Comparison>(Runtime::GreaterOrEqual, std::move(result), ParseExpression());
+            tokens.NextToken();
+            return make_unique<Ast::ComparisonOf<Runtime::CompareOp::GreaterOrEqual>>(std::move(result), ParseExpression());
         } else {
             return result;
         }
@@ -392,18 +410,21 @@ class Parser {
     //Statement -> SimpleStatement Newline
     //           | class ClassDefinition
     //           | if Condition
+    //           | while Loop
     unique_ptr<Ast::Statement> ParseStatement() {
-        const auto &tok = lexer.CurrentToken();
+        const auto &tok = tokens.CurrentToken();
 
         if (tok.Is<TokenType::Class>()) {
-            lexer.NextToken();
+            tokens.NextToken();
             return ParseClassDefinition();
         } else if (tok.Is<TokenType::If>()) {
             return ParseCondition();
+        } else if (tok.Is<TokenType::While>()) {
+            return ParseLoop();
         } else {
             auto result = ParseSimpleStatement();
-            lexer.Expect<TokenType::Newline>();
-            lexer.NextToken();
+            tokens.Expect<TokenType::Newline>();
+            tokens.NextToken();
             return result;
         }
     }
@@ -412,15 +433,15 @@ class Parser {
     //               | print ExpressionList
     //               | AssignmentOrCall
     unique_ptr<Ast::Statement> ParseSimpleStatement() {
-        const auto &tok = lexer.CurrentToken();
+        const auto &tok = tokens.CurrentToken();
 
         if (tok.Is<TokenType::Return>()) {
-            lexer.NextToken();
+            tokens.NextToken();
             return make_unique<Ast::Return>(ParseTest());
         } else if (tok.Is<TokenType::Print>()) {
-            lexer.NextToken();
+            tokens.NextToken();
             vector<unique_ptr<Ast::Statement>> args;
-            if (!lexer.CurrentToken().Is<TokenType::Newline>()) {
+            if (!tokens.CurrentToken().Is<TokenType::Newline>()) {
                 args = ParseTestList();
             }
             return make_unique<Ast::Print>(std::move(args));
@@ -431,5 +452,15 @@ class Parser {
 };
 
 unique_ptr<Ast::Statement> ParseProgram(Parse::Lexer &lexer) {
-    return Parser{lexer}.ParseProgram();
+    return ParseProgram(Parse::TokenArray(lexer));
+}
+
+unique_ptr<Ast::Statement> ParseProgram(const Parse::TokenArray &tokens) {
+    Parse::TokenCursor cursor(tokens);
+    return Parser{cursor}.ParseProgram();
+}
+
+unique_ptr<Ast::Statement> ParseProgram(Parse::TokenPipe &pipe) {
+    Parse::TokenCursor cursor(pipe);
+    return Parser{cursor}.ParseProgram();
 }
@@ -10,6 +10,8 @@ class Statement;
 
 namespace Parse {
 class Lexer;
+class TokenArray;
+class TokenPipe;
 }
 
 class TestRunner;
@@ -18,6 +20,14 @@ struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+// Doesn't stream: the tokens the lexer has left are all put into a TokenArray first, which takes
+// twelve bytes per token with its line and a side table entry per name and string. Then the array
+// is parsed. The TokenPipe overload parses while the program is still being lexed.
 std::unique_ptr<Ast::Statement> ParseProgram(Parse::Lexer &lexer);
 
+std::unique_ptr<Ast::Statement> ParseProgram(const Parse::TokenArray &tokens);
+
+// Parses the tokens while the pipe is still lexing the rest of the program
+std::unique_ptr<Ast::Statement> ParseProgram(Parse::TokenPipe &pipe);
+
 void TestParseProgram(TestRunner &tr);
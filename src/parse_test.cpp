@@ -255,6 +255,121 @@ print r, c, t1, t2
     ASSERT_EQUAL(os.str(), "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n");
 }
 
+void TestStoredSelf() {
+    const string program = R"(
+class Registry:
+  def __init__():
+    self.last = None
+
+class Node:
+  def __init__(registry, name):
+    self.name = name
+    registry.last = self
+
+  def rename(registry, name):
+    self.name = name
+    registry.last = self
+
+  def __str__():
+    return 'Node ' + self.name
+
+r = Registry()
+n = Node(r, 'first')
+n = None
+print r.last
+n = Node(r, 'second')
+n.rename(r, 'third')
+n = None
+print r.last
+)";
+
+    ostringstream os;
+    Ast::Print::SetOutputStream(os);
+
+    Runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    tree->Execute(closure);
+
+    ASSERT_EQUAL(os.str(), "Node first\nNode third\n");
+}
+
+void TestWhile() {
+    const string program = R"(
+class Search:
+  def first_square_above(limit):
+    n = 0
+    while True:
+      n = n + 1
+      if n * n > limit:
+        return n
+
+i = 0
+total = 0
+while i < 5:
+  j = 0
+  while j < i:
+    total = total + j
+    j = j + 1
+  i = i + 1
+s = Search()
+print i, total, s.first_square_above(50)
+)";
+
+    ostringstream os;
+    Ast::Print::SetOutputStream(os);
+
+    Runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    tree->Execute(closure);
+
+    ASSERT_EQUAL(os.str(), "5 10 8\n");
+}
+
+void TestLocalSlots() {
+    const string program = R"(
+class Counter:
+  def count(n):
+    if n == 0:
+      return 0
+    before = n
+    rest = self.count(n - 1)
+    return before + rest
+
+  def pair(a, b):
+    class Pair:
+      def __str__():
+        return 'pair'
+    p = Pair()
+    return str(p) + ' ' + str(b) + ' ' + str(a)
+
+  def unassigned(flag):
+    if flag:
+      x = 1
+    return x
+
+c = Counter()
+print c.count(4), c.pair(1, 2)
+print c.unassigned(True)
+)";
+
+    ostringstream os;
+    Ast::Print::SetOutputStream(os);
+
+    Runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    tree->Execute(closure);
+
+    ASSERT_EQUAL(os.str(), "10 pair 2 1\n1\n");
+
+    string error;
+    try {
+        auto instance = closure.at("c");
+        instance.TryAs<Runtime::ClassInstance>()->Call("unassigned", {ObjectHolder::Own(Runtime::Bool(false))});
+    } catch (const std::runtime_error &e) {
+        error = e.what();
+    }
+    ASSERT_EQUAL(error, "Variable x not found in closure");
+}
 
 }
 
@@ -267,4 +382,7 @@ void TestParseProgram(TestRunner &tr) {
     RUN_TEST(tr, Parse::TestRecursion2);
     RUN_TEST(tr, Parse::TestComplexLogicalExpression);
     RUN_TEST(tr, Parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, Parse::TestStoredSelf);
+    RUN_TEST(tr, Parse::TestLocalSlots);
+    RUN_TEST(tr, Parse::TestWhile);
 }
@@ -0,0 +1,69 @@
+#include "resolve.h"
+#include "statement.h"
+
+#include <unordered_map>
+
+
+using namespace std;
+
+namespace Ast {
+
+namespace {
+
+const Symbol SelfName = "self";
+
+class LocalsResolver : public Visitor {
+ public:
+    using Visitor::Visit;
+
+    size_t Bind(Symbol name) {
+        auto [it, inserted] = slots.emplace(name, frame_size);
+        if (inserted) {
+            ++frame_size;
+        }
+        return it->second;
+    }
+
+    // Like Bind, but a repeated parameter name refers to the last argument, as in the closure
+    void BindParameter(Symbol name, size_t slot) {
+        slots[name] = slot;
+        frame_size = slot + 1;
+    }
+
+    size_t FrameSize() const {
+        return frame_size;
+    }
+
+    void Visit(VariableValue &node) override {
+        node.slot = Bind(node.dotted_ids.front());
+    }
+
+    void Visit(Assignment &node) override {
+        Visitor::Visit(node);
+        node.slot = Bind(node.var_name);
+    }
+
+    void Visit(ClassDefinition &node) override {
+        // Methods of a nested class were resolved when it was parsed
+        node.slot = Bind(node.class_name);
+    }
+
+ private:
+    unordered_map<Symbol, size_t> slots;
+    size_t frame_size = 0;
+};
+
+}
+
+void ResolveLocals(Runtime::Method &method) {
+    LocalsResolver resolver;
+    resolver.Bind(SelfName);
+    for (size_t i = 0; i < method.formal_params.size(); ++i) {
+        resolver.BindParameter(method.formal_params[i], i + 1);
+    }
+
+    method.body->Accept(resolver);
+    method.frame_size = resolver.FrameSize();
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace Runtime {
+struct Method;
+}
+
+namespace Ast {
+
+// Binds every variable of the method body to a slot of the method's frame:
+// self is slot 0, the parameters follow it, then the other locals.
+void ResolveLocals(Runtime::Method &method);
+
+}
@@ -0,0 +1,228 @@
+#include "scan.h"
+
+#include <cstdint>
+#include <initializer_list>
+
+// SSE2 is part of every x86-64 processor, AVX2 is checked for at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SITHON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+
+using namespace std;
+
+namespace Parse::Scan {
+
+namespace {
+
+bool IsIdChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool IsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+template<bool (*Belongs)(char)>
+const char *SkipScalar(const char *it, const char *end) {
+    while (it != end && Belongs(*it)) {
+        ++it;
+    }
+    return it;
+}
+
+const char *FindQuoteScalar(const char *it, const char *end, char quote) {
+    while (it != end && *it != quote) {
+        ++it;
+    }
+    return it;
+}
+
+const Kernels kScalar = {
+    Isa::Scalar,
+    SkipScalar<IsIdChar>,
+    SkipScalar<IsDigit>,
+    SkipScalar<IsSpace>,
+    FindQuoteScalar,
+};
+
+#ifdef SITHON_SCAN_X86
+
+// Runs the classifier over whole blocks while they fit before end, the rest goes character by character.
+// The classifier gives a bit for every character that ends the run.
+#define SITHON_SCAN_LOOP(width, stop_mask, scalar_tail)                                              \
+    for (; end - it >= (width); it += (width)) {                                                     \
+        if (uint32_t stop = (stop_mask)) {                                                           \
+            return it + __builtin_ctz(stop);                                                         \
+        }                                                                                            \
+    }                                                                                                \
+    return scalar_tail
+
+// Unsigned lo <= x <= hi for every byte, SSE2 has only signed comparisons
+__m128i InRange16(__m128i x, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x),
+                         _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x));
+}
+
+uint32_t Sse2Mask(__m128i belongs) {
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(belongs)) & 0xFFFF;
+}
+
+__m128i Load16(const char *it) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+}
+
+__m128i IdChars16(__m128i x) {
+    // Setting bit 5 turns upper case letters into lower case and nothing else into letters
+    __m128i letters = InRange16(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i underscores = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letters, underscores), InRange16(x, '0', '9'));
+}
+
+__m128i Spaces16(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), InRange16(x, '\t', '\r'));
+}
+
+const char *SkipIdCharsSse2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(16, Sse2Mask(IdChars16(Load16(it))), SkipScalar<IsIdChar>(it, end));
+}
+
+const char *SkipDigitsSse2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(16, Sse2Mask(InRange16(Load16(it), '0', '9')), SkipScalar<IsDigit>(it, end));
+}
+
+const char *SkipSpacesSse2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(16, Sse2Mask(Spaces16(Load16(it))), SkipScalar<IsSpace>(it, end));
+}
+
+const char *FindQuoteSse2(const char *it, const char *end, char quote) {
+    const __m128i quotes = _mm_set1_epi8(quote);
+    SITHON_SCAN_LOOP(16, static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Load16(it), quotes))),
+                     FindQuoteScalar(it, end, quote));
+}
+
+const Kernels kSse2 = {
+    Isa::Sse2,
+    SkipIdCharsSse2,
+    SkipDigitsSse2,
+    SkipSpacesSse2,
+    FindQuoteSse2,
+};
+
+// Compiled for AVX2 regardless of the build flags, used only when the processor has it
+#define SITHON_AVX2 __attribute__((target("avx2")))
+
+SITHON_AVX2 __m256i InRange32(__m256i x, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(lo)), x),
+                            _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(hi)), x));
+}
+
+SITHON_AVX2 uint32_t Avx2Mask(__m256i belongs) {
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(belongs));
+}
+
+SITHON_AVX2 __m256i Load32(const char *it) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+}
+
+SITHON_AVX2 __m256i IdChars32(__m256i x) {
+    __m256i letters = InRange32(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i underscores = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letters, underscores), InRange32(x, '0', '9'));
+}
+
+SITHON_AVX2 __m256i Spaces32(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), InRange32(x, '\t', '\r'));
+}
+
+// The tails shorter than a block go to the SSE2 kernels
+SITHON_AVX2 const char *SkipIdCharsAvx2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(32, Avx2Mask(IdChars32(Load32(it))), SkipIdCharsSse2(it, end));
+}
+
+SITHON_AVX2 const char *SkipDigitsAvx2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(32, Avx2Mask(InRange32(Load32(it), '0', '9')), SkipDigitsSse2(it, end));
+}
+
+SITHON_AVX2 const char *SkipSpacesAvx2(const char *it, const char *end) {
+    SITHON_SCAN_LOOP(32, Avx2Mask(Spaces32(Load32(it))), SkipSpacesSse2(it, end));
+}
+
+SITHON_AVX2 const char *FindQuoteAvx2(const char *it, const char *end, char quote) {
+    const __m256i quotes = _mm256_set1_epi8(quote);
+    SITHON_SCAN_LOOP(32, static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Load32(it), quotes))),
+                     FindQuoteSse2(it, end, quote));
+}
+
+#undef SITHON_AVX2
+#undef SITHON_SCAN_LOOP
+
+const Kernels kAvx2 = {
+    Isa::Avx2,
+    SkipIdCharsAvx2,
+    SkipDigitsAvx2,
+    SkipSpacesAvx2,
+    FindQuoteAvx2,
+};
+
+#endif
+
+const Kernels *&ActivePointer() {
+    static const Kernels *active = [] {
+        for (Isa isa : {Isa::Avx2, Isa::Sse2}) {
+            if (auto kernels = KernelsFor(isa)) {
+                return kernels;
+            }
+        }
+        return &kScalar;
+    }();
+    return active;
+}
+
+}
+
+const Kernels *KernelsFor(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar:
+            return &kScalar;
+#ifdef SITHON_SCAN_X86
+        case Isa::Sse2:
+            return &kSse2;
+        case Isa::Avx2:
+            return __builtin_cpu_supports("avx2") ? &kAvx2 : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const Kernels &Active() {
+    return *ActivePointer();
+}
+
+bool SetActive(Isa isa) {
+    if (auto kernels = KernelsFor(isa)) {
+        ActivePointer() = kernels;
+        return true;
+    }
+    return false;
+}
+
+const char *IsaName(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar:
+            return "scalar";
+        case Isa::Sse2:
+            return "sse2";
+        case Isa::Avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+} /* namespace Parse::Scan */
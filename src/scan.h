@@ -0,0 +1,41 @@
+#pragma once
+
+
+class TestRunner;
+
+namespace Parse::Scan {
+
+// Instruction sets the scanning kernels are written for, from the plainest
+enum class Isa {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+// Each kernel returns the first character in [begin, end) that doesn't belong to the run, or end.
+// Vector versions classify 16 or 32 characters at a time and never read outside the range.
+struct Kernels {
+    Isa isa;
+    // Letters, digits and underscores
+    const char *(*skip_id_chars)(const char *begin, const char *end);
+    const char *(*skip_digits)(const char *begin, const char *end);
+    // Characters isspace accepts in the "C" locale
+    const char *(*skip_spaces)(const char *begin, const char *end);
+    // The run ends at the first quote character
+    const char *(*find_quote)(const char *begin, const char *end, char quote);
+};
+
+// Kernels for the set, or nullptr if the processor doesn't support it
+const Kernels *KernelsFor(Isa isa);
+
+// Kernels the lexer uses: the widest the processor supports, unless set otherwise
+const Kernels &Active();
+
+// Returns false and keeps the active kernels if the processor doesn't support the set
+bool SetActive(Isa isa);
+
+const char *IsaName(Isa isa);
+
+void RunScanTests(TestRunner &tr);
+
+} /* namespace Parse::Scan */
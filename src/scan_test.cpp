@@ -0,0 +1,78 @@
+#include "scan.h"
+#include "test_runner.h"
+
+#include <string>
+
+
+using namespace std;
+
+namespace Parse::Scan {
+
+namespace {
+
+// Every run the kernels find must end where the scalar kernels say, wherever it
+// starts and ends relative to the vector blocks
+void CompareWithScalar(const Kernels &kernels, const string &text) {
+    const Kernels &scalar = *KernelsFor(Isa::Scalar);
+    const char *end = text.data() + text.size();
+    for (const char *it = text.data(); it <= end; ++it) {
+        ASSERT_EQUAL(kernels.skip_id_chars(it, end) - it, scalar.skip_id_chars(it, end) - it);
+        ASSERT_EQUAL(kernels.skip_digits(it, end) - it, scalar.skip_digits(it, end) - it);
+        ASSERT_EQUAL(kernels.skip_spaces(it, end) - it, scalar.skip_spaces(it, end) - it);
+        ASSERT_EQUAL(kernels.find_quote(it, end, '\'') - it, scalar.find_quote(it, end, '\'') - it);
+        ASSERT_EQUAL(kernels.find_quote(it, end, '"') - it, scalar.find_quote(it, end, '"') - it);
+    }
+}
+
+}
+
+void TestScalarKernels() {
+    const Kernels &scalar = *KernelsFor(Isa::Scalar);
+    const string text = "  \t\r\v\fname_42 1234x 'quoted \"text\"'";
+    const char *begin = text.data(), *end = begin + text.size();
+
+    ASSERT_EQUAL(scalar.skip_spaces(begin, end) - begin, 6);
+    ASSERT_EQUAL(scalar.skip_id_chars(begin + 6, end) - begin, 13);
+    ASSERT_EQUAL(scalar.skip_digits(begin + 14, end) - begin, 18);
+    ASSERT_EQUAL(scalar.find_quote(begin + 21, end, '\'') - begin, 34);
+    ASSERT_EQUAL(scalar.find_quote(begin + 21, end, '"') - begin, 28);
+    ASSERT_EQUAL(scalar.skip_digits(end, end) - begin, 35);
+}
+
+void TestVectorKernels() {
+    string every_byte;
+    for (int c = 0; c < 256; ++c) {
+        every_byte += static_cast<char>(c);
+        every_byte += static_cast<char>(255 - c);
+    }
+    const string runs[] = {
+        every_byte,
+        string(100, 'a') + "!" + string(70, '7') + "@" + string(40, ' ') + "\"" + string(33, '_') + "'",
+        string(64, 'Z') + "[" + string(31, '0') + "/" + string(17, '\t') + "`" + string(45, 'x'),
+        string(97, '\r'),
+    };
+    for (Isa isa : {Isa::Sse2, Isa::Avx2}) {
+        if (auto kernels = KernelsFor(isa)) {
+            ASSERT(kernels->isa == isa);
+            for (const string &text : runs) {
+                CompareWithScalar(*kernels, text);
+            }
+        }
+    }
+}
+
+void TestSetActive() {
+    Isa initial = Active().isa;
+    ASSERT(SetActive(Isa::Scalar));
+    ASSERT(Active().isa == Isa::Scalar);
+    ASSERT_EQUAL(SetActive(Isa::Avx2), KernelsFor(Isa::Avx2) != nullptr);
+    ASSERT(SetActive(initial));
+}
+
+void RunScanTests(TestRunner &tr) {
+    RUN_TEST(tr, Parse::Scan::TestScalarKernels);
+    RUN_TEST(tr, Parse::Scan::TestVectorKernels);
+    RUN_TEST(tr, Parse::Scan::TestSetActive);
+}
+
+} /* namespace Parse::Scan */
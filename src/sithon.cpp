@@ -1,11 +1,16 @@
 #include "object.h"
 #include "object_holder.h"
 #include "statement.h"
+#include "bytecode.h"
+#include "optimize.h"
 #include "lexer.h"
 #include "parse.h"
+#include "scan.h"
+#include "token_pipe.h"
 #include "test_runner.h"
 #include "complex_tests.h"
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -13,26 +18,92 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string_view>
 
 
 using namespace std;
 
 void TestAll();
 
-void RunSithonProgram(istream &input, ostream &output) {
+enum class Engine {
+    TreeWalker,
+    Bytecode,
+};
+
+enum class FrontEnd {
+    // The whole program is lexed before parsing starts
+    Sequential,
+    // The lexer runs on its own thread ahead of the parser
+    Pipelined,
+};
+
+// Writes how long the stages took to the timings stream, if there is one
+void RunSithonProgram(Parse::SourceBuffer source, ostream &output, Engine engine = Engine::Bytecode,
+                      FrontEnd front_end = FrontEnd::Sequential, ostream *timings = nullptr) {
     Ast::Print::SetOutputStream(output);
 
-    Parse::Lexer lexer(input);
-    auto program = ParseProgram(lexer);
+    auto start = chrono::steady_clock::now();
+    auto stage_done = [&start, timings](const char *stage) {
+        auto now = chrono::steady_clock::now();
+        if (timings) {
+            *timings << stage << ": " << chrono::duration<double, milli>(now - start).count() << " ms" << endl;
+        }
+        start = now;
+    };
+
+    unique_ptr<Ast::Statement> program;
+    if (front_end == FrontEnd::Pipelined) {
+        Parse::TokenPipe pipe(std::move(source));
+        program = ParseProgram(pipe);
+        stage_done("lex and parse");
+    } else {
+        Parse::Lexer lexer(std::move(source));
+        Parse::TokenArray tokens(lexer);
+        stage_done("lex");
+        program = ParseProgram(tokens);
+        stage_done("parse");
+    }
+
+    if (engine == Engine::Bytecode) {
+        auto code = Bytecode::CompileProgram(*program);
+        stage_done("compile");
+        Bytecode::Run(*code);
+    } else {
+        Runtime::Closure closure;
+        program->Execute(closure);
+    }
+    stage_done("run");
+}
 
-    Runtime::Closure closure;
-    program->Execute(closure);
+void RunSithonProgram(istream &input, ostream &output, Engine engine = Engine::Bytecode) {
+    RunSithonProgram(Parse::SourceBuffer(input), output, engine);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     TestAll();
 
-    RunSithonProgram(cin, cout);
+    Engine engine = Engine::Bytecode;
+    string script;
+    bool time_stages = false;
+    FrontEnd front_end = FrontEnd::Sequential;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (arg == "--tree-walker"sv) {
+            engine = Engine::TreeWalker;
+        } else if (arg.substr(0, 14) == "--stack-limit="sv) {
+            // In megabytes
+            Bytecode::SetStackLimit(stoull(string(arg.substr(14))) << 20);
+        } else if (arg == "--time-stages"sv) {
+            time_stages = true;
+        } else if (arg == "--pipelined"sv) {
+            front_end = FrontEnd::Pipelined;
+        } else {
+            script = arg;
+        }
+    }
+    // Both ways the lexer works over the whole text in memory
+    Parse::SourceBuffer source = script.empty() ? Parse::SourceBuffer(cin) : Parse::SourceBuffer::MapFile(script);
+    RunSithonProgram(std::move(source), cout, engine, front_end, time_stages ? &cerr : nullptr);
 
     return 0;
 }
@@ -119,11 +190,16 @@ print y.value
 
 void TestAll() {
     TestRunner tr;
+    Runtime::RunSymbolTests(tr);
     Runtime::RunObjectHolderTests(tr);
     Runtime::RunObjectsTests(tr);
     Ast::RunUnitTests(tr);
+    Parse::Scan::RunScanTests(tr);
     Parse::RunLexerTests(tr);
+    Parse::RunTokenPipeTests(tr);
     TestParseProgram(tr);
+    Ast::RunOptimizerTests(tr);
+    Bytecode::RunBytecodeTests(tr);
 
     RUN_TEST(tr, TestSimplePrints);
     RUN_TEST(tr, TestAssignments);
@@ -11,46 +11,179 @@ namespace Ast {
 
 using Runtime::Closure;
 
+void Visitor::Visit(NumericConst &) {
+}
+
+void Visitor::Visit(StringConst &) {
+}
+
+void Visitor::Visit(BoolConst &) {
+}
+
+void Visitor::Visit(VariableValue &) {
+}
+
+void Visitor::Visit(Assignment &node) {
+    node.right_value->Accept(*this);
+}
+
+void Visitor::Visit(FieldAssignment &node) {
+    node.object.Accept(*this);
+    node.right_value->Accept(*this);
+}
+
+void Visitor::Visit(None &) {
+}
+
+void Visitor::Visit(Print &node) {
+    for (auto &arg : node.args) {
+        arg->Accept(*this);
+    }
+}
+
+void Visitor::Visit(MethodCall &node) {
+    for (auto &arg : node.args) {
+        arg->Accept(*this);
+    }
+    node.object->Accept(*this);
+}
+
+void Visitor::Visit(NewInstance &node) {
+    for (auto &arg : node.args) {
+        arg->Accept(*this);
+    }
+}
+
+void Visitor::Visit(Stringify &node) {
+    node.argument->Accept(*this);
+}
+
+void Visitor::Visit(Add &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(Sub &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(Mult &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(Div &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(Or &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(And &node) {
+    node.lhs->Accept(*this);
+    node.rhs->Accept(*this);
+}
+
+void Visitor::Visit(Not &node) {
+    node.argument->Accept(*this);
+}
+
+void Visitor::Visit(Negate &node) {
+    node.argument->Accept(*this);
+}
+
+void Visitor::Visit(Compound &node) {
+    for (auto &stmt : node.statements) {
+        stmt->Accept(*this);
+    }
+}
+
+void Visitor::Visit(Return &node) {
+    node.statement->Accept(*this);
+}
+
+void Visitor::Visit(ClassDefinition &) {
+}
+
+void Visitor::Visit(IfElse &node) {
+    node.condition->Accept(*this);
+    node.if_body->Accept(*this);
+    if (node.else_body) {
+        node.else_body->Accept(*this);
+    }
+}
+
+void Visitor::Visit(While &node) {
+    node.condition->Accept(*this);
+    node.body->Accept(*this);
+}
+
+void Visitor::Visit(Comparison &node) {
+    node.left->Accept(*this);
+    node.right->Accept(*this);
+}
+
 ObjectHolder Assignment::Execute(Closure &closure) {
+    if (slot != kNoSlot) {
+        return closure.Slot(slot) = right_value->Execute(closure);
+    }
     return closure[var_name] = right_value->Execute(closure);
 }
 
-Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
+Assignment::Assignment(Symbol var, std::unique_ptr<Statement> rv)
     : var_name(std::move(var)), right_value(std::move(rv)) {
 }
 
-VariableValue::VariableValue(std::string var_name)
+VariableValue::VariableValue(Symbol var_name)
     : dotted_ids(1, std::move(var_name)) {
 }
 
-VariableValue::VariableValue(std::vector<std::string> dotted_ids)
+VariableValue::VariableValue(std::vector<Symbol> dotted_ids)
     : dotted_ids(std::move(dotted_ids)) {
     if (this->dotted_ids.empty()) {
         throw std::runtime_error("You can't create VariableValue with empty dotted_ids");
     }
+    field_caches.resize(this->dotted_ids.size() - 1);
 }
 
-ObjectHolder VariableValue::Execute(Closure &closure) {
-    auto *cur_closure = &closure;
+std::runtime_error NameNotFound(Symbol name, bool last) {
+    if (last) {
+        return std::runtime_error("Variable " + name.Name() + " not found in closure");
+    }
+    return std::runtime_error("Name " + name.Name() + " not found in the scope");
+}
 
-    for (size_t i = 0; i + 1 < dotted_ids.size(); ++i) {
-        if (auto it = cur_closure->find(dotted_ids[i]); it == cur_closure->end()) {
-            throw std::runtime_error("Name " + dotted_ids[i] + " not found in the scope");
-        } else if (auto p = it->second.TryAs<Runtime::ClassInstance>(); p) {
-            cur_closure = &p->Fields();
-        } else {
-            throw std::runtime_error(dotted_ids[i] + " is not an object, can't access its fields");
+ObjectHolder VariableValue::Execute(Closure &closure) {
+    ObjectHolder *value = nullptr;
+    if (slot != kNoSlot) {
+        if (auto &local = closure.Slot(slot); !Runtime::Frame::IsUnset(local)) {
+            value = &local;
         }
+    } else if (auto it = closure.find(dotted_ids.front()); it != closure.end()) {
+        value = &it->second;
     }
 
-    if (auto it = cur_closure->find(dotted_ids.back()); it != closure.end()) {
-        return it->second;
-    } else {
-        throw std::runtime_error("Variable " + dotted_ids.back() + " not found in closure");
+    if (!value) {
+        throw NameNotFound(dotted_ids.front(), dotted_ids.size() == 1);
+    }
+    for (size_t i = 1; i < dotted_ids.size(); ++i) {
+        if (auto p = value->TryAs<Runtime::ClassInstance>(); p) {
+            value = p->FindField(dotted_ids[i], field_caches[i - 1]);
+        } else {
+            throw std::runtime_error(dotted_ids[i - 1].Name() + " is not an object, can't access its fields");
+        }
+        if (!value) {
+            throw NameNotFound(dotted_ids[i], i + 1 == dotted_ids.size());
+        }
     }
+    return *value;
 }
 
-unique_ptr<Print> Print::Variable(std::string var) {
+unique_ptr<Print> Print::Variable(Symbol var) {
     return make_unique<Print>(make_unique<VariableValue>(std::move(var)));
 }
 
@@ -86,13 +219,22 @@ void Print::SetOutputStream(ostream &output_stream) {
     output = &output_stream;
 }
 
+ostream &Print::GetOutputStream() {
+    return *output;
+}
+
 MethodCall::MethodCall(
-    std::unique_ptr<Statement> object, std::string method, std::vector<std::unique_ptr<Statement>> args
+    std::unique_ptr<Statement> object, Symbol method, std::vector<std::unique_ptr<Statement>> args
 )
     : object(std::move(object)), method(std::move(method)), args(std::move(args)) {
 }
 
 ObjectHolder MethodCall::Execute(Closure &closure) {
+    auto call = Bind(closure);
+    return call.object.TryAs<Runtime::ClassInstance>()->Invoke(*call.method, call.args);
+}
+
+Runtime::TailCall MethodCall::Bind(Closure &closure) {
     vector<ObjectHolder> actual_args;
     for (auto &stmt : args) {
         actual_args.push_back(stmt->Execute(closure));
@@ -100,37 +242,62 @@ ObjectHolder MethodCall::Execute(Closure &closure) {
 
     ObjectHolder callee = object->Execute(closure);
     if (auto *instance = callee.TryAs<Runtime::ClassInstance>(); instance) {
-        return instance->Call(method, actual_args);
+        const auto &m = method_cache.Lookup(instance->GetClass(), method, actual_args.size());
+        return {std::move(callee), &m, std::move(actual_args)};
     } else {
-        throw std::runtime_error("Trying to call method " + method + " on object whicj is not a class instance");
+        throw std::runtime_error("Trying to call method " + method.Name() + " on object whicj is not a class instance");
     }
 }
 
 ObjectHolder Stringify::Execute(Closure &closure) {
-    ObjectHolder arg_value = argument->Execute(closure);
+    return Evaluate(argument->Execute(closure));
+}
 
+ObjectHolder Stringify::Evaluate(ObjectHolder arg_value) {
     std::ostringstream os;
-    arg_value->Print(os);
+    // Same text print gives
+    if (arg_value) {
+        arg_value->Print(os);
+    } else {
+        os << "None";
+    }
 
     return ObjectHolder::Own(Runtime::String(os.str()));
 }
 
-template<typename T>
-bool TryAddValues(const ObjectHolder &left, const ObjectHolder &right, ObjectHolder &result) {
-    auto l = left.TryAs<T>();
-    auto r = right.TryAs<T>();
-    if (l && r) {
-        result = ObjectHolder::Own(T(l->GetValue() + r->GetValue()));
-        return true;
+Specialization Respecialize(Specialization current, const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    using Runtime::Kind;
+    using Runtime::KindPair;
+
+    Specialization observed = Specialization::Generic;
+    switch (KindPair(lhs.GetKind(), rhs.GetKind())) {
+        case KindPair(Kind::Number, Kind::Number):
+            observed = Specialization::Numbers;
+            break;
+        case KindPair(Kind::String, Kind::String):
+            observed = Specialization::Strings;
+            break;
+        default:
+            break;
     }
-    return false;
+
+    if (current == Specialization::Uninitialized || current == observed) {
+        return observed;
+    } else {
+        return Specialization::Generic;
+    }
+}
+
+template<typename T>
+ObjectHolder AddValues(const ObjectHolder &left, const ObjectHolder &right) {
+    return ObjectHolder::Own(T(left.TryAs<T>()->GetValue() + right.TryAs<T>()->GetValue()));
 }
 
-bool TryAddInstances(ObjectHolder &left, ObjectHolder &right, ObjectHolder &result) {
+bool TryAddInstances(ObjectHolder left, const ObjectHolder &right, ObjectHolder &result) {
     if (auto l = left.TryAs<Runtime::ClassInstance>(); !l) {
         return false;
-    } else if (l->HasMethod("__add__", 1)) {
-        result = l->Call("__add__", {right});
+    } else if (auto *add = l->GetClass().GetMethod(Runtime::SpecialMethod::Slot::Add)) {
+        result = l->Invoke(*add, {right});
         return true;
     } else {
         return false;
@@ -141,13 +308,29 @@ ObjectHolder Add::Execute(Closure &closure) {
     auto left = lhs->Execute(closure);
     auto right = rhs->Execute(closure);
 
-    ObjectHolder result;
+    if (specialization == Specialization::Numbers && BothAre<Runtime::Number>(left, right)) {
+        return AddValues<Runtime::Number>(left, right);
+    } else if (specialization == Specialization::Strings && BothAre<Runtime::String>(left, right)) {
+        return AddValues<Runtime::String>(left, right);
+    }
 
-    bool success = TryAddValues<Runtime::Number>(left, right, result);
-    success = success || TryAddValues<Runtime::String>(left, right, result);
-    success = success || TryAddInstances(left, right, result);
+    specialization = Respecialize(specialization, left, right);
+    return Evaluate(left, right);
+}
 
-    if (success) {
+ObjectHolder Add::Evaluate(const ObjectHolder &left, const ObjectHolder &right) {
+    using Runtime::Kind;
+    using Runtime::KindPair;
+    switch (KindPair(left.GetKind(), right.GetKind())) {
+        case KindPair(Kind::Number, Kind::Number):
+            return AddValues<Runtime::Number>(left, right);
+        case KindPair(Kind::String, Kind::String):
+            return AddValues<Runtime::String>(left, right);
+        default:
+            break;
+    }
+
+    if (ObjectHolder result; TryAddInstances(left, right, result)) {
         return result;
     } else {
         throw std::runtime_error("Addition isn't supported for these operands");
@@ -158,6 +341,15 @@ ObjectHolder Sub::Execute(Closure &closure) {
     auto left = lhs->Execute(closure);
     auto right = rhs->Execute(closure);
 
+    if (specialization == Specialization::Numbers && BothAre<Runtime::Number>(left, right)) {
+        return ObjectHolder::Own(Runtime::Number(ValueOf<Runtime::Number>(left) - ValueOf<Runtime::Number>(right)));
+    }
+
+    specialization = Respecialize(specialization, left, right);
+    return Evaluate(left, right);
+}
+
+ObjectHolder Sub::Evaluate(const ObjectHolder &left, const ObjectHolder &right) {
     auto left_number = left.TryAs<Runtime::Number>();
     auto right_number = right.TryAs<Runtime::Number>();
 
@@ -174,6 +366,15 @@ ObjectHolder Mult::Execute(Runtime::Closure &closure) {
     auto left = lhs->Execute(closure);
     auto right = rhs->Execute(closure);
 
+    if (specialization == Specialization::Numbers && BothAre<Runtime::Number>(left, right)) {
+        return ObjectHolder::Own(Runtime::Number(ValueOf<Runtime::Number>(left) * ValueOf<Runtime::Number>(right)));
+    }
+
+    specialization = Respecialize(specialization, left, right);
+    return Evaluate(left, right);
+}
+
+ObjectHolder Mult::Evaluate(const ObjectHolder &left, const ObjectHolder &right) {
     auto left_number = left.TryAs<Runtime::Number>();
     auto right_number = right.TryAs<Runtime::Number>();
 
@@ -190,6 +391,16 @@ ObjectHolder Div::Execute(Runtime::Closure &closure) {
     auto left = lhs->Execute(closure);
     auto right = rhs->Execute(closure);
 
+    if (specialization == Specialization::Numbers && BothAre<Runtime::Number>(left, right)
+        && ValueOf<Runtime::Number>(right) != 0) {
+        return ObjectHolder::Own(Runtime::Number(ValueOf<Runtime::Number>(left) / ValueOf<Runtime::Number>(right)));
+    }
+
+    specialization = Respecialize(specialization, left, right);
+    return Evaluate(left, right);
+}
+
+ObjectHolder Div::Evaluate(const ObjectHolder &left, const ObjectHolder &right) {
     auto left_number = left.TryAs<Runtime::Number>();
     auto right_number = right.TryAs<Runtime::Number>();
 
@@ -207,25 +418,44 @@ ObjectHolder Div::Execute(Runtime::Closure &closure) {
 ObjectHolder Compound::Execute(Closure &closure) {
     for (auto &stmt : statements) {
         stmt->Execute(closure);
+        if (closure.IsReturning()) {
+            break;
+        }
     }
     return ObjectHolder::None();
 }
 
+Return::Return(std::unique_ptr<Statement> statement)
+    : statement(std::move(statement)), call(dynamic_cast<MethodCall *>(this->statement.get())) {
+}
+
 ObjectHolder Return::Execute(Closure &closure) {
-    throw statement->Execute(closure);
+    // The method's caller runs a returned call, so the native stack doesn't grow with it
+    if (call && closure.HasFrame()) {
+        closure.SetTailCall(call->Bind(closure));
+    } else {
+        closure.SetReturnValue(statement->Execute(closure));
+    }
+    return ObjectHolder::None();
 }
 
+// Takes the symbol the class keeps rather than interning its name again: the parser mustn't
+// create symbols while the lexer thread of a TokenPipe does
 ClassDefinition::ClassDefinition(ObjectHolder class_)
-    : cls(std::move(class_)), class_name(dynamic_cast<const Runtime::Class &>(*cls).GetName()) {
+    : cls(std::move(class_)), class_name(dynamic_cast<const Runtime::Class &>(*cls.Get()).GetName()) {
 }
 
 ObjectHolder ClassDefinition::Execute(Runtime::Closure &closure) {
-    closure[class_name] = cls;
+    if (slot != kNoSlot) {
+        closure.Slot(slot) = cls;
+    } else {
+        closure[class_name] = cls;
+    }
     return ObjectHolder::None();
 }
 
 FieldAssignment::FieldAssignment(
-    VariableValue object, std::string field_name, std::unique_ptr<Statement> rv
+    VariableValue object, Symbol field_name, std::unique_ptr<Statement> rv
 )
     : object(std::move(object)), field_name(std::move(field_name)), right_value(std::move(rv)) {
 }
@@ -233,9 +463,9 @@ FieldAssignment::FieldAssignment(
 ObjectHolder FieldAssignment::Execute(Runtime::Closure &closure) {
     auto instance = object.Execute(closure);
     if (auto p = instance.TryAs<Runtime::ClassInstance>(); p) {
-        return p->Fields()[field_name] = right_value->Execute(closure);
+        return p->SetField(field_name, right_value->Execute(closure), field_cache);
     } else {
-        throw std::runtime_error("Cannot assign to the field " + field_name + " of not an object");
+        throw std::runtime_error("Cannot assign to the field " + field_name.Name() + " of not an object");
     }
 }
 
@@ -257,6 +487,20 @@ ObjectHolder IfElse::Execute(Runtime::Closure &closure) {
     return ObjectHolder::None();
 }
 
+While::While(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> body)
+    : condition(std::move(condition)), body(std::move(body)) {
+}
+
+ObjectHolder While::Execute(Runtime::Closure &closure) {
+    while (IsTrue(condition->Execute(closure))) {
+        body->Execute(closure);
+        if (closure.IsReturning()) {
+            break;
+        }
+    }
+    return ObjectHolder::None();
+}
+
 ObjectHolder Or::Execute(Runtime::Closure &closure) {
     if (IsTrue(lhs->Execute(closure)) || IsTrue(rhs->Execute(closure))) {
         return ObjectHolder::Own(Runtime::Bool(true));
@@ -277,16 +521,22 @@ ObjectHolder Not::Execute(Runtime::Closure &closure) {
     return ObjectHolder::Own(Runtime::Bool(!IsTrue(argument->Execute(closure))));
 }
 
-Comparison::Comparison(
-    Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs
-)
-    : comparator(std::move(cmp)), left(std::move(lhs)), right(std::move(rhs)) {
+ObjectHolder Negate::Execute(Runtime::Closure &closure) {
+    return Evaluate(argument->Execute(closure));
 }
 
-ObjectHolder Comparison::Execute(Runtime::Closure &closure) {
-    return ObjectHolder::Own(
-        Runtime::Bool(comparator(left->Execute(closure), right->Execute(closure)))
-    );
+ObjectHolder Negate::Evaluate(const ObjectHolder &arg_value) {
+    if (auto number = arg_value.TryAs<Runtime::Number>(); number) {
+        return ObjectHolder::Own(Runtime::Number(-number->GetValue()));
+    } else {
+        throw std::runtime_error("Negation is supported only for integers");
+    }
+}
+
+Comparison::Comparison(
+    Runtime::CompareOp op, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs
+)
+    : op(op), left(std::move(lhs)), right(std::move(rhs)) {
 }
 
 NewInstance::NewInstance(
@@ -299,16 +549,18 @@ NewInstance::NewInstance(const Runtime::Class &class_) : NewInstance(class_, {})
 }
 
 ObjectHolder NewInstance::Execute(Runtime::Closure &closure) {
-    Runtime::ClassInstance result(class_);
-    if (auto *m = class_.GetMethod("__init__"); m) {
+    // The instance must be owned before __init__ runs, so that self stored elsewhere stays valid
+    auto result = ObjectHolder::Own(Runtime::ClassInstance(class_));
+    if (auto *m = class_.GetMethod(Runtime::SpecialMethod::Slot::Init); m) {
         vector<ObjectHolder> actual_args;
         for (auto &stmt : args) {
             actual_args.push_back(stmt->Execute(closure));
         }
 
-        result.Call("__init__", actual_args);
+        const auto &init = class_.ResolveMethod(*m, actual_args.size());
+        result.TryAs<Runtime::ClassInstance>()->Invoke(init, actual_args);
     }
-    return ObjectHolder::Own(std::move(result));
+    return result;
 }
 
 
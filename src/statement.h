@@ -2,10 +2,10 @@
 
 #include "object_holder.h"
 #include "object.h"
+#include "comparators.h"
 
 #include <unordered_map>
 #include <string>
-#include <functional>
 #include <memory>
 #include <vector>
 
@@ -14,12 +14,80 @@ class TestRunner;
 
 namespace Ast {
 
+template<typename T>
+struct ValueStatement;
+
+using NumericConst = ValueStatement<Runtime::Number>;
+using StringConst = ValueStatement<Runtime::String>;
+using BoolConst = ValueStatement<Runtime::Bool>;
+
+struct VariableValue;
+struct Assignment;
+struct FieldAssignment;
+struct None;
+class Print;
+struct MethodCall;
+struct NewInstance;
+class Stringify;
+class Add;
+class Sub;
+class Mult;
+class Div;
+class Or;
+class And;
+class Not;
+class Negate;
+class Compound;
+class Return;
+class ClassDefinition;
+class IfElse;
+class While;
+class Comparison;
+
+// Pass over a syntax tree. By default every Visit just visits children
+// of the node in the order they are executed.
+class Visitor {
+ public:
+    virtual ~Visitor() = default;
+
+    virtual void Visit(NumericConst &node);
+    virtual void Visit(StringConst &node);
+    virtual void Visit(BoolConst &node);
+    virtual void Visit(VariableValue &node);
+    virtual void Visit(Assignment &node);
+    virtual void Visit(FieldAssignment &node);
+    virtual void Visit(None &node);
+    virtual void Visit(Print &node);
+    virtual void Visit(MethodCall &node);
+    virtual void Visit(NewInstance &node);
+    virtual void Visit(Stringify &node);
+    virtual void Visit(Add &node);
+    virtual void Visit(Sub &node);
+    virtual void Visit(Mult &node);
+    virtual void Visit(Div &node);
+    virtual void Visit(Or &node);
+    virtual void Visit(And &node);
+    virtual void Visit(Not &node);
+    virtual void Visit(Negate &node);
+    virtual void Visit(Compound &node);
+    virtual void Visit(Return &node);
+    virtual void Visit(ClassDefinition &node);
+    virtual void Visit(IfElse &node);
+    virtual void Visit(While &node);
+    virtual void Visit(Comparison &node);
+};
+
 struct Statement {
     virtual ~Statement() = default;
 
     virtual ObjectHolder Execute(Runtime::Closure &closure) = 0;
+
+    virtual void Accept(Visitor &visitor) = 0;
 };
 
+// Frame slot of a name that isn't resolved to a local variable and is looked up in the closure
+constexpr size_t kNoSlot = -1;
+
 template<typename T>
 struct ValueStatement : Statement {
     T value;
@@ -28,47 +96,76 @@ struct ValueStatement : Statement {
     }
 
     ObjectHolder Execute(Runtime::Closure &) override {
-        return ObjectHolder::Share(value);
+        if constexpr (ObjectHolder::IsImmediate<T>) {
+            return ObjectHolder::Own(T(value));
+        } else {
+            return ObjectHolder::Share(value);
+        }
+    }
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
     }
 };
 
-using NumericConst = ValueStatement<Runtime::Number>;
-using StringConst = ValueStatement<Runtime::String>;
-using BoolConst = ValueStatement<Runtime::Bool>;
+// Error for a name of a dotted expression that isn't set. Only the last name is reported as
+// a variable, the ones before it must lead to objects.
+std::runtime_error NameNotFound(Symbol name, bool last);
 
 struct VariableValue : Statement {
-    std::vector<std::string> dotted_ids;
+    std::vector<Symbol> dotted_ids;
+    std::vector<Runtime::FieldCache> field_caches;
+    // Frame slot of the first name, assigned by the resolver inside method bodies
+    size_t slot = kNoSlot;
 
-    explicit VariableValue(std::string var_name);
+    explicit VariableValue(Symbol var_name);
 
-    explicit VariableValue(std::vector<std::string> dotted_ids);
+    explicit VariableValue(std::vector<Symbol> dotted_ids);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 struct Assignment : Statement {
-    std::string var_name;
+    Symbol var_name;
     std::unique_ptr<Statement> right_value;
+    size_t slot = kNoSlot;
 
-    Assignment(std::string var, std::unique_ptr<Statement> rv);
+    Assignment(Symbol var, std::unique_ptr<Statement> rv);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 struct FieldAssignment : Statement {
     VariableValue object;
-    std::string field_name;
+    Symbol field_name;
     std::unique_ptr<Statement> right_value;
+    Runtime::FieldCache field_cache;
 
-    FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+    FieldAssignment(VariableValue object, Symbol field_name, std::unique_ptr<Statement> rv);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 struct None : Statement {
     ObjectHolder Execute(Runtime::Closure &) override {
         return ObjectHolder();
     }
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Print : public Statement {
@@ -77,29 +174,44 @@ class Print : public Statement {
 
     explicit Print(std::vector<std::unique_ptr<Statement>> args);
 
-    static std::unique_ptr<Print> Variable(std::string name);
+    static std::unique_ptr<Print> Variable(Symbol name);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
 
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
     static void SetOutputStream(std::ostream &output_stream);
 
- private:
+    static std::ostream &GetOutputStream();
+
     std::vector<std::unique_ptr<Statement>> args;
+
+ private:
     static std::ostream *output;
 };
 
 struct MethodCall : Statement {
     std::unique_ptr<Statement> object;
-    std::string method;
+    Symbol method;
     std::vector<std::unique_ptr<Statement>> args;
+    Runtime::MethodCache method_cache;
 
     MethodCall(
         std::unique_ptr<Statement> object,
-        std::string method,
+        Symbol method,
         std::vector<std::unique_ptr<Statement>> args
     );
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    // Evaluates the arguments and the object and finds the method, but doesn't call it
+    Runtime::TailCall Bind(Runtime::Closure &closure);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 struct NewInstance : Statement {
@@ -111,6 +223,10 @@ struct NewInstance : Statement {
     NewInstance(const Runtime::Class &class_, std::vector<std::unique_ptr<Statement>> args);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class UnaryOperation : public Statement {
@@ -118,7 +234,6 @@ class UnaryOperation : public Statement {
     UnaryOperation(std::unique_ptr<Statement> argument) : argument(std::move(argument)) {
     }
 
- protected:
     std::unique_ptr<Statement> argument;
 };
 
@@ -127,16 +242,48 @@ class Stringify : public UnaryOperation {
     using UnaryOperation::UnaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(ObjectHolder arg_value);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
+// Operand types an operation has seen. A node specializes itself to the types of its first
+// operands and takes a fast path for them, until operands of other types make it generic for good.
+enum class Specialization : uint8_t {
+    Uninitialized,
+    Numbers,
+    Strings,
+    Generic,
+};
+
+Specialization Respecialize(Specialization current, const ObjectHolder &lhs, const ObjectHolder &rhs);
+
+template<typename T>
+bool BothAre(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    return lhs.GetKind() == T::kKind && rhs.GetKind() == T::kKind;
+}
+
+// Numbers may be stored in the holder itself, so they are returned by value
+template<typename T>
+decltype(auto) ValueOf(const ObjectHolder &object) {
+    if constexpr (std::is_same_v<T, Runtime::Number>) {
+        return static_cast<int>(object.TryAs<T>()->GetValue());
+    } else {
+        return object.TryAs<T>()->GetValue();
+    }
+}
+
 class BinaryOperation : public Statement {
  public:
     BinaryOperation(std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs)
         : lhs(std::move(lhs)), rhs(std::move(rhs)) {
     }
 
- protected:
     std::unique_ptr<Statement> lhs, rhs;
+    Specialization specialization = Specialization::Uninitialized;
 };
 
 class Add : public BinaryOperation {
@@ -144,6 +291,12 @@ class Add : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(const ObjectHolder &left, const ObjectHolder &right);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Sub : public BinaryOperation {
@@ -151,6 +304,12 @@ class Sub : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(const ObjectHolder &left, const ObjectHolder &right);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Mult : public BinaryOperation {
@@ -158,6 +317,12 @@ class Mult : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(const ObjectHolder &left, const ObjectHolder &right);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Div : public BinaryOperation {
@@ -165,6 +330,12 @@ class Div : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(const ObjectHolder &left, const ObjectHolder &right);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Or : public BinaryOperation {
@@ -172,6 +343,10 @@ class Or : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class And : public BinaryOperation {
@@ -179,6 +354,10 @@ class And : public BinaryOperation {
     using BinaryOperation::BinaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Not : public UnaryOperation {
@@ -186,6 +365,23 @@ class Not : public UnaryOperation {
     using UnaryOperation::UnaryOperation;
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+};
+
+class Negate : public UnaryOperation {
+ public:
+    using UnaryOperation::UnaryOperation;
+
+    ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    static ObjectHolder Evaluate(const ObjectHolder &arg_value);
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 };
 
 class Compound : public Statement {
@@ -201,20 +397,29 @@ class Compound : public Statement {
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
 
- private:
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
     std::vector<std::unique_ptr<Statement>> statements;
 };
 
 class Return : public Statement {
  public:
-    explicit Return(std::unique_ptr<Statement> statement)
-        : statement(std::move(statement)) {
-    }
+    explicit Return(std::unique_ptr<Statement> statement);
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
 
- private:
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
     std::unique_ptr<Statement> statement;
+
+ private:
+    // The statement if it's a method call, which is then run as a tail call. The optimizer
+    // may change the arguments of a call but never replaces the call itself.
+    MethodCall *call;
 };
 
 class ClassDefinition : public Statement {
@@ -223,9 +428,13 @@ class ClassDefinition : public Statement {
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
 
- private:
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
     ObjectHolder cls;
-    const std::string &class_name;
+    Symbol class_name;
+    size_t slot = kNoSlot;
 };
 
 class IfElse : public Statement {
@@ -238,25 +447,67 @@ class IfElse : public Statement {
 
     ObjectHolder Execute(Runtime::Closure &closure) override;
 
- private:
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
     std::unique_ptr<Statement> condition, if_body, else_body;
 };
 
-class Comparison : public Statement {
+// The body runs in the scope of the loop itself, so an iteration doesn't allocate anything
+class While : public Statement {
  public:
-    using Comparator = std::function<bool(const ObjectHolder &, const ObjectHolder &)>;
+    While(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> body);
+
+    ObjectHolder Execute(Runtime::Closure &closure) override;
+
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
+
+    std::unique_ptr<Statement> condition, body;
+};
 
+// Comparison with one of the operators of the language. The operator is a template
+// parameter of the concrete node, which runs its comparator without another virtual call.
+class Comparison : public Statement {
+ public:
     Comparison(
-        Comparator cmp,
+        Runtime::CompareOp op,
         std::unique_ptr<Statement> lhs,
         std::unique_ptr<Statement> rhs
     );
 
-    ObjectHolder Execute(Runtime::Closure &closure) override;
+    void Accept(Visitor &visitor) override {
+        visitor.Visit(*this);
+    }
 
- private:
-    Comparator comparator;
+    const Runtime::CompareOp op;
     std::unique_ptr<Statement> left, right;
+    Specialization specialization = Specialization::Uninitialized;
+};
+
+template<Runtime::CompareOp Op>
+class ComparisonOf final : public Comparison {
+ public:
+    ComparisonOf(std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs)
+        : Comparison(Op, std::move(lhs), std::move(rhs)) {
+    }
+
+    ObjectHolder Execute(Runtime::Closure &closure) override {
+        auto lhs = left->Execute(closure);
+        return ObjectHolder::Own(Runtime::Bool(Compare(lhs, right->Execute(closure))));
+    }
+
+    bool Compare(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+        if (specialization == Specialization::Numbers && BothAre<Runtime::Number>(lhs, rhs)) {
+            return Runtime::CompareValues<Op>(ValueOf<Runtime::Number>(lhs), ValueOf<Runtime::Number>(rhs));
+        } else if (specialization == Specialization::Strings && BothAre<Runtime::String>(lhs, rhs)) {
+            return Runtime::CompareValues<Op>(ValueOf<Runtime::String>(lhs), ValueOf<Runtime::String>(rhs));
+        }
+        specialization = Respecialize(specialization, lhs, rhs);
+        return Runtime::Compare<Op>(lhs, rhs);
+    }
 };
 
 void RunUnitTests(TestRunner &tr);
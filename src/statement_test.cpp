@@ -108,12 +108,12 @@ void TestFieldAssignment() {
         ASSERT(o);
         ASSERT_OBJECT_VALUE_EQUAL(o, 57);
     }
-    ASSERT(object.Fields().find("x") != object.Fields().end());
-    ASSERT_OBJECT_VALUE_EQUAL(object.Fields().at("x"), 57);
+    ASSERT(object.FindField("x"));
+    ASSERT_OBJECT_VALUE_EQUAL(*object.FindField("x"), 57);
 
     assign_y.Execute(closure);
     FieldAssignment assign_yz(
-        VariableValue{vector<string>{"self", "y"}}, "z", make_unique<StringConst>(
+        VariableValue{vector<Symbol>{"self", "y"}}, "z", make_unique<StringConst>(
             Runtime::String("Hello, world! Hooray! Yes-yes!!!")
         )
     );
@@ -123,10 +123,10 @@ void TestFieldAssignment() {
         ASSERT_OBJECT_VALUE_EQUAL(o, "Hello, world! Hooray! Yes-yes!!!");
     }
 
-    ASSERT(object.Fields().find("y") != object.Fields().end());
-    auto subobject = object.Fields().at("y").TryAs<Runtime::ClassInstance>();
-    ASSERT(subobject && subobject->Fields().find("z") != subobject->Fields().end());
-    ASSERT_OBJECT_VALUE_EQUAL(subobject->Fields().at("z"), "Hello, world! Hooray! Yes-yes!!!");
+    ASSERT(object.FindField("y"));
+    auto subobject = object.FindField("y")->TryAs<Runtime::ClassInstance>();
+    ASSERT(subobject && subobject->FindField("z"));
+    ASSERT_OBJECT_VALUE_EQUAL(*subobject->FindField("z"), "Hello, world! Hooray! Yes-yes!!!");
 }
 
 void TestPrintVariable() {
@@ -278,6 +278,110 @@ void TestCompound() {
     ASSERT(!result);
 }
 
+void TestReturn() {
+    Compound body{
+        make_unique<Assignment>("x", make_unique<NumericConst>(1)),
+        make_unique<IfElse>(
+            make_unique<BoolConst>(Runtime::Bool(true)),
+            make_unique<Compound>(
+                make_unique<Return>(make_unique<StringConst>("early"s)),
+                make_unique<Assignment>("y", make_unique<NumericConst>(2))
+            ),
+            nullptr
+        ),
+        make_unique<Assignment>("z", make_unique<NumericConst>(3)),
+    };
+
+    Closure closure;
+    ASSERT(!body.Execute(closure));
+    ASSERT(closure.IsReturning());
+    ASSERT_OBJECT_VALUE_EQUAL(closure.TakeReturnValue(), "early");
+    ASSERT(!closure.IsReturning());
+    ASSERT(closure.find("x") != closure.end());
+    ASSERT(closure.find("y") == closure.end());
+    ASSERT(closure.find("z") == closure.end());
+
+    vector<Runtime::Method> methods;
+    methods.push_back({"first", {"x"}, make_unique<Compound>(
+        make_unique<Return>(make_unique<VariableValue>("x")),
+        make_unique<Return>(make_unique<NumericConst>(0))
+    )});
+    methods.push_back({"nothing", {}, make_unique<Compound>()});
+    Runtime::Class cls("Returns", std::move(methods), nullptr);
+    Runtime::ClassInstance instance(cls);
+
+    ASSERT_OBJECT_VALUE_EQUAL(instance.Call("first", {ObjectHolder::Own(Runtime::Number(5))}), 5);
+    ASSERT(!instance.Call("nothing", {}));
+}
+
+void TestMethodCallCache() {
+    vector<Runtime::Method> base_methods;
+    base_methods.push_back({"value", {"x"}, make_unique<VariableValue>("x")});
+    Runtime::Class base("Base", std::move(base_methods), nullptr);
+
+    vector<Runtime::Method> derived_methods;
+    derived_methods.push_back({"value", {"x"}, make_unique<StringConst>("derived"s)});
+    Runtime::Class derived("Derived", std::move(derived_methods), &base);
+
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<NumericConst>(57));
+    MethodCall call(make_unique<VariableValue>("obj"), "value", std::move(args));
+
+    Runtime::MethodCache::ResetStats();
+
+    Closure closure = {{"obj", ObjectHolder::Own(Runtime::ClassInstance(base))}};
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure), 57);
+    }
+    ASSERT_EQUAL(Runtime::MethodCache::GetStats().misses, 1u);
+    ASSERT_EQUAL(Runtime::MethodCache::GetStats().hits, 2u);
+
+    closure["obj"] = ObjectHolder::Own(Runtime::ClassInstance(derived));
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure), "derived");
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure), "derived");
+    closure["obj"] = ObjectHolder::Own(Runtime::ClassInstance(base));
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure), 57);
+    ASSERT_EQUAL(Runtime::MethodCache::GetStats().misses, 2u);
+    ASSERT_EQUAL(Runtime::MethodCache::GetStats().hits, 4u);
+
+    MethodCall wrong_arity(make_unique<VariableValue>("obj"), "value", {});
+    ASSERT_THROWS(wrong_arity.Execute(closure), std::runtime_error);
+    MethodCall unknown(make_unique<VariableValue>("obj"), "unknown", {});
+    ASSERT_THROWS(unknown.Execute(closure), std::runtime_error);
+}
+
+void TestQuickening() {
+    Add sum(make_unique<VariableValue>("x"), make_unique<VariableValue>("y"));
+    ComparisonOf<Runtime::CompareOp::Less> less(make_unique<VariableValue>("x"), make_unique<VariableValue>("y"));
+    ASSERT(sum.specialization == Specialization::Uninitialized);
+
+    Closure closure = {{"x", ObjectHolder::Own(Runtime::Number(2))}, {"y", ObjectHolder::Own(Runtime::Number(3))}};
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure), 5);
+        ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure), "True");
+    }
+    ASSERT(sum.specialization == Specialization::Numbers);
+    ASSERT(less.specialization == Specialization::Numbers);
+
+    // Operands of another type are still handled, by the generic path from now on
+    closure["x"] = ObjectHolder::Own(Runtime::String("b"));
+    closure["y"] = ObjectHolder::Own(Runtime::String("a"));
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure), "ba");
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure), "False");
+    ASSERT(sum.specialization == Specialization::Generic);
+    ASSERT(less.specialization == Specialization::Generic);
+
+    closure["x"] = ObjectHolder::Own(Runtime::Number(7));
+    closure["y"] = ObjectHolder::Own(Runtime::Number(7));
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure), 14);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure), "False");
+
+    Div div(make_unique<VariableValue>("x"), make_unique<VariableValue>("y"));
+    ASSERT_OBJECT_VALUE_EQUAL(div.Execute(closure), 1);
+    closure["y"] = ObjectHolder::Own(Runtime::Number(0));
+    ASSERT_THROWS(div.Execute(closure), std::runtime_error);
+}
+
 void RunUnitTests(TestRunner &tr) {
     RUN_TEST(tr, Ast::TestNumericConst);
     RUN_TEST(tr, Ast::TestStringConst);
@@ -293,6 +397,9 @@ void RunUnitTests(TestRunner &tr) {
     RUN_TEST(tr, Ast::TestSuccessfullClassInstanceAdd);
     RUN_TEST(tr, Ast::TestClassInstanceAddWithoutMethod);
     RUN_TEST(tr, Ast::TestCompound);
+    RUN_TEST(tr, Ast::TestReturn);
+    RUN_TEST(tr, Ast::TestMethodCallCache);
+    RUN_TEST(tr, Ast::TestQuickening);
 }
 
 } /* namespace Ast */
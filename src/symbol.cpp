@@ -0,0 +1,53 @@
+#include "symbol.h"
+
+#include <deque>
+#include <ostream>
+#include <unordered_map>
+
+
+using namespace std;
+
+namespace Runtime {
+
+struct Symbol::Table {
+    // Deque never moves its elements, so entries and views of their names stay valid
+    deque<Entry> entries;
+    unordered_map<string_view, const Entry *> index;
+};
+
+Symbol::Table &Symbol::GetTable() {
+    static Table table;
+    return table;
+}
+
+Symbol::Symbol() {
+    static const Entry *empty = Intern({});
+    entry = empty;
+}
+
+Symbol::Symbol(string_view name) : entry(Intern(name)) {
+}
+
+size_t Symbol::Count() {
+    return GetTable().entries.size();
+}
+
+const Symbol::Entry *Symbol::Intern(string_view name) {
+    auto &table = GetTable();
+    if (auto it = table.index.find(name); it != table.index.end()) {
+        return it->second;
+    }
+
+    table.entries.push_back({
+        string(name), std::hash<string_view>()(name), static_cast<uint32_t>(table.entries.size())
+    });
+    const auto &entry = table.entries.back();
+    table.index.emplace(entry.name, &entry);
+    return &entry;
+}
+
+ostream &operator<<(ostream &os, Symbol symbol) {
+    return os << symbol.Name();
+}
+
+} /* namespace Runtime */
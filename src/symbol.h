@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+
+class TestRunner;
+
+namespace Runtime {
+
+// Interned identifier. All symbols with the same name refer to a single entry of
+// the global symbol table, so they are compared by pointer and hashed by a value
+// computed once. The table isn't synchronized: symbols are created on one thread.
+class Symbol {
+ public:
+    Symbol();
+
+    Symbol(std::string_view name);
+
+    Symbol(const std::string &name) : Symbol(std::string_view(name)) {
+    }
+
+    Symbol(const char *name) : Symbol(std::string_view(name)) {
+    }
+
+    const std::string &Name() const {
+        return entry->name;
+    }
+
+    // Dense number of the symbol, in the order symbols were first interned
+    uint32_t Id() const {
+        return entry->id;
+    }
+
+    size_t Hash() const {
+        return entry->hash;
+    }
+
+    bool operator==(Symbol other) const {
+        return entry == other.entry;
+    }
+
+    bool operator!=(Symbol other) const {
+        return entry != other.entry;
+    }
+
+    // Number of distinct symbols interned so far
+    static size_t Count();
+
+ private:
+    struct Entry {
+        std::string name;
+        size_t hash;
+        uint32_t id;
+    };
+
+    struct Table;
+
+    static Table &GetTable();
+
+    static const Entry *Intern(std::string_view name);
+
+    const Entry *entry;
+};
+
+std::ostream &operator<<(std::ostream &os, Symbol symbol);
+
+void RunSymbolTests(TestRunner &tr);
+
+} /* namespace Runtime */
+
+template<>
+struct std::hash<Runtime::Symbol> {
+    size_t operator()(Runtime::Symbol symbol) const {
+        return symbol.Hash();
+    }
+};
+
+using Symbol = Runtime::Symbol;
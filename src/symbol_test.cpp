@@ -0,0 +1,67 @@
+#include "symbol.h"
+#include "lexer.h"
+#include "test_runner.h"
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+
+using namespace std;
+
+namespace Runtime {
+
+void TestInterning() {
+    Symbol x("x");
+    Symbol other_x(string("x"));
+    Symbol y = "y";
+
+    ASSERT(x == other_x);
+    ASSERT(x != y);
+    ASSERT_EQUAL(x.Id(), other_x.Id());
+    ASSERT(x.Id() != y.Id());
+    ASSERT_EQUAL(x.Hash(), other_x.Hash());
+    ASSERT_EQUAL(x.Name(), "x");
+    ASSERT_EQUAL(Symbol().Name(), "");
+
+    size_t count = Symbol::Count();
+    Symbol again("y");
+    ASSERT_EQUAL(Symbol::Count(), count);
+    Symbol fresh("a symbol nobody has used before");
+    ASSERT_EQUAL(Symbol::Count(), count + 1);
+    ASSERT_EQUAL(fresh.Id() + 1, count + 1);
+
+    ostringstream os;
+    os << x << y;
+    ASSERT_EQUAL(os.str(), "xy");
+}
+
+void TestSymbolKeys() {
+    unordered_map<Symbol, int> values = {{"one", 1}, {"two", 2}};
+    ASSERT_EQUAL(values.at("one"), 1);
+    ASSERT_EQUAL(values.at(Symbol(string("tw") + "o")), 2);
+    ASSERT(values.find("three") == values.end());
+}
+
+void TestLexerInternsIds() {
+    istringstream input("value = value + other_value\n");
+    Parse::Lexer lexer(input);
+
+    Symbol first = lexer.CurrentToken().As<Parse::TokenType::Id>().value;
+    lexer.NextToken();
+    Symbol second = lexer.ExpectNext<Parse::TokenType::Id>().value;
+    lexer.NextToken();
+    Symbol third = lexer.ExpectNext<Parse::TokenType::Id>().value;
+
+    ASSERT(first == second);
+    ASSERT(first == Symbol("value"));
+    ASSERT(first != third);
+}
+
+void RunSymbolTests(TestRunner &tr) {
+    RUN_TEST(tr, Runtime::TestInterning);
+    RUN_TEST(tr, Runtime::TestSymbolKeys);
+    RUN_TEST(tr, Runtime::TestLexerInternsIds);
+}
+
+} /* namespace Runtime */
@@ -0,0 +1,96 @@
+#include "token_pipe.h"
+
+
+using namespace std;
+
+namespace Parse {
+
+namespace {
+
+// Tokens the lexer puts into the ring before it makes them visible to the parser
+constexpr size_t kPublishBatch = 64;
+
+}
+
+TokenPipe::TokenPipe(SourceBuffer source, size_t capacity) : ring(capacity) {
+    // The empty symbol is created on first use, which mustn't happen on both threads at once
+    Symbol();
+    thread = std::thread([this, source = std::move(source)]() mutable {
+        Produce(std::move(source));
+    });
+}
+
+TokenPipe::~TokenPipe() {
+    cancelled.store(true, memory_order_relaxed);
+    thread.join();
+}
+
+void TokenPipe::Produce(SourceBuffer source) {
+    try {
+        lexer = make_unique<Lexer>(std::move(source));
+        for (size_t count = 1;; ++count, lexer->NextToken()) {
+            Item *item;
+            while (!(item = ring.Reserve())) {
+                ring.Publish();
+                if (cancelled.load(memory_order_relaxed)) {
+                    return;
+                }
+                this_thread::yield();
+            }
+            item->token = lexer->CurrentToken();
+            item->line = lexer->CurrentLineNumber();
+            if (item->token.Is<TokenType::Eof>()) {
+                break;
+            }
+            if (count % kPublishBatch == 0) {
+                ring.Publish();
+                // The parser may have given up while the ring still has room
+                if (cancelled.load(memory_order_relaxed)) {
+                    return;
+                }
+            }
+        }
+    } catch (...) {
+        error = current_exception();
+    }
+    // Tokens lexed before an error still go to the parser, it gets the error after them
+    ring.Publish();
+    finished.store(true, memory_order_release);
+}
+
+bool TokenPipe::Receive() {
+    if (received.Size() > 0 && received[received.Size() - 1].Is<TokenType::Eof>()) {
+        return false;
+    }
+    for (;;) {
+        if (size_t count = ring.Available()) {
+            for (; count > 0; --count) {
+                received.Append(ring.Front().token, ring.Front().line);
+                ring.Pop();
+            }
+            ring.Release();
+            return true;
+        }
+        if (finished.load(memory_order_acquire)) {
+            // Everything the lexer published is visible by now
+            if (ring.Available() > 0) {
+                continue;
+            }
+            if (error) {
+                rethrow_exception(error);
+            }
+            return false;
+        }
+        this_thread::yield();
+    }
+}
+
+TokenCursor::TokenCursor(TokenPipe &pipe) : tokens(pipe.Received()), pipe(&pipe), current(Fetch(0)) {
+}
+
+void TokenCursor::Receive(size_t at) const {
+    while (at >= tokens.Size() && pipe->Receive()) {
+    }
+}
+
+} /* namespace Parse */
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+class TestRunner;
+
+namespace Parse {
+
+// Queue of fixed capacity between one producer thread and one consumer thread. Each side
+// owns one index and only reads the other's, so no locks are needed. The capacity must be
+// a power of two.
+template<typename T>
+class SpscRing {
+ public:
+    explicit SpscRing(size_t capacity) : slots(capacity), mask(capacity - 1) {
+    }
+
+    // Producer side: the first free slot, or nullptr if the ring is full.
+    // The item becomes visible to the consumer with Publish.
+    T *Reserve() {
+        if (reserved - cached_tail == slots.size()) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (reserved - cached_tail == slots.size()) {
+                return nullptr;
+            }
+        }
+        return &slots[reserved++ & mask];
+    }
+
+    void Publish() {
+        head.store(reserved, std::memory_order_release);
+    }
+
+    // Consumer side: number of items that can be read with Front and Pop
+    size_t Available() {
+        if (read == cached_head) {
+            cached_head = head.load(std::memory_order_acquire);
+        }
+        return cached_head - read;
+    }
+
+    T &Front() {
+        return slots[read & mask];
+    }
+
+    void Pop() {
+        ++read;
+    }
+
+    // Gives the slots of the popped items back to the producer
+    void Release() {
+        tail.store(read, std::memory_order_release);
+    }
+
+ private:
+    std::vector<T> slots;
+    const size_t mask;
+
+    // Written by the producer
+    alignas(64) std::atomic<size_t> head{0};
+    size_t reserved = 0;
+    size_t cached_tail = 0;
+
+    // Written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t read = 0;
+    size_t cached_head = 0;
+};
+
+// Lexes a program on its own thread while the parser takes the tokens from a ring. The lexer
+// thread is the only one creating symbols while it runs: the symbol table isn't synchronized.
+class TokenPipe {
+ public:
+    static constexpr size_t kDefaultCapacity = 1 << 14;
+
+    explicit TokenPipe(SourceBuffer source, size_t capacity = kDefaultCapacity);
+
+    TokenPipe(const TokenPipe &) = delete;
+
+    TokenPipe &operator=(const TokenPipe &) = delete;
+
+    // Stops the lexer if the parser gave up before the end
+    ~TokenPipe();
+
+    // Tokens taken from the ring so far
+    const TokenArray &Received() const {
+        return received;
+    }
+
+    // Waits for more tokens and adds them to Received. Returns false when Eof has already
+    // been received, rethrows the error if the lexer failed.
+    bool Receive();
+
+ private:
+    struct Item {
+        Token token;
+        int line = 0;
+    };
+
+    void Produce(SourceBuffer source);
+
+    SpscRing<Item> ring;
+    TokenArray received;
+    std::unique_ptr<Lexer> lexer;
+    std::exception_ptr error;
+    std::atomic<bool> finished{false};
+    std::atomic<bool> cancelled{false};
+    std::thread thread;
+};
+
+void RunTokenPipeTests(TestRunner &tr);
+
+} /* namespace Parse */
@@ -0,0 +1,149 @@
+#include "token_pipe.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+
+using namespace std;
+
+namespace Parse {
+
+void TestRingKeepsOrder() {
+    // Small enough to wrap around and fill up many times
+    SpscRing<int> ring(4);
+    const int count = 10000;
+    thread producer([&ring] {
+        for (int i = 0; i < count; ++i) {
+            int *slot;
+            while (!(slot = ring.Reserve())) {
+                ring.Publish();
+                this_thread::yield();
+            }
+            *slot = i;
+            if (i % 3 == 0) {
+                ring.Publish();
+            }
+        }
+        ring.Publish();
+    });
+
+    int expected = 0;
+    while (expected < count) {
+        if (size_t available = ring.Available()) {
+            ASSERT(available <= 4);
+            for (; available > 0; --available, ++expected) {
+                ASSERT_EQUAL(ring.Front(), expected);
+                ring.Pop();
+            }
+            ring.Release();
+        } else {
+            this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT_EQUAL(ring.Available(), 0u);
+}
+
+void TestPipeGivesLexerTokens() {
+    const string program = R"(
+class Counter:
+  def count(n):
+    while n > 0:
+      n = n - 1
+    return 'done ' + str(n)
+
+print Counter().count(10), "and", None
+)";
+    istringstream input(program);
+    Lexer lexer(input);
+    TokenPipe pipe(SourceBuffer{program}, 8);
+    TokenCursor cursor(pipe);
+
+    ASSERT_EQUAL(cursor.Peek(15), Token(TokenType::Char{'>'}));
+    while (!lexer.CurrentToken().Is<TokenType::Eof>()) {
+        ASSERT_EQUAL(cursor.CurrentToken(), lexer.CurrentToken());
+        ASSERT_EQUAL(cursor.CurrentLineNumber(), lexer.CurrentLineNumber());
+        lexer.NextToken();
+        cursor.NextToken();
+    }
+    ASSERT_EQUAL(cursor.CurrentToken(), Token(TokenType::Eof{}));
+    ASSERT_EQUAL(cursor.NextToken(), Token(TokenType::Eof{}));
+    ASSERT(!pipe.Receive());
+}
+
+void TestPipeParsesProgram() {
+    string program;
+    for (int i = 0; i < 1000; ++i) {
+        program += "x" + to_string(i % 10) + " = " + to_string(i) + "\n";
+    }
+    program += "print x0 + x9, 'end'\n";
+
+    ostringstream output;
+    Ast::Print::SetOutputStream(output);
+    TokenPipe pipe(SourceBuffer{program}, 16);
+    auto tree = ParseProgram(pipe);
+    Runtime::Closure closure;
+    tree->Execute(closure);
+    ASSERT_EQUAL(output.str(), "1989 end\n");
+}
+
+void TestPipeParsesClasses() {
+    // Every class brings new names, the lexer creates their symbols while the parser builds classes
+    string program;
+    for (int i = 0; i < 300; ++i) {
+        string n = to_string(i);
+        program += "class C" + n + (i > 0 ? "(C" + to_string(i - 1) + ")" : "") + ":\n";
+        program += "  def get_" + n + "():\n    return " + n + "\n";
+    }
+    program += "x = C299()\nprint x.get_0() + x.get_299()\n";
+
+    ostringstream output;
+    Ast::Print::SetOutputStream(output);
+    TokenPipe pipe(SourceBuffer{program}, 16);
+    auto tree = ParseProgram(pipe);
+    Runtime::Closure closure;
+    tree->Execute(closure);
+    ASSERT_EQUAL(output.str(), "299\n");
+}
+
+void TestPipeErrors() {
+    {
+        // Tokens lexed before the error reach the parser first, even if they don't fill a batch
+        TokenPipe pipe(SourceBuffer{string("x = 1\nprint 'unbalanced\n")});
+        TokenCursor cursor(pipe);
+        ASSERT_EQUAL(cursor.CurrentToken(), Token(TokenType::Id{"x"}));
+        ASSERT_EQUAL(cursor.NextToken(), Token(TokenType::Char{'='}));
+        ASSERT_EQUAL(cursor.NextToken(), Token(TokenType::Number{1}));
+        ASSERT_EQUAL(cursor.NextToken(), Token(TokenType::Newline{}));
+        ASSERT_EQUAL(cursor.NextToken(), Token(TokenType::Print{}));
+        ASSERT_THROWS(cursor.NextToken(), LexerError);
+    }
+    {
+        // The lexer fails on its thread, the parser gets the error where the bad token would be
+        TokenPipe pipe(SourceBuffer{string("x = 1\nprint 'unbalanced\n")});
+        ASSERT_THROWS(ParseProgram(pipe), LexerError);
+    }
+    {
+        // The parser gives up while the lexer waits for room in the ring
+        string program = "x = = 1\n";
+        for (int i = 0; i < 1000; ++i) {
+            program += "y = 2\n";
+        }
+        TokenPipe pipe(SourceBuffer{program}, 4);
+        ASSERT_THROWS(ParseProgram(pipe), runtime_error);
+    }
+}
+
+void RunTokenPipeTests(TestRunner &tr) {
+    RUN_TEST(tr, Parse::TestRingKeepsOrder);
+    RUN_TEST(tr, Parse::TestPipeGivesLexerTokens);
+    RUN_TEST(tr, Parse::TestPipeParsesProgram);
+    RUN_TEST(tr, Parse::TestPipeParsesClasses);
+    RUN_TEST(tr, Parse::TestPipeErrors);
+}
+
+} /* namespace Parse */
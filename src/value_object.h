@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+namespace Runtime {
+
+// Compact type tag of a runtime object. Hot paths switch on it instead of
+// probing the object with dynamic_cast; Kind::None denotes an empty holder.
+enum class Kind : uint8_t {
+    None,
+    Number,
+    String,
+    Bool,
+    Class,
+    ClassInstance,
+    Other,
+};
+
+constexpr unsigned KindPair(Kind lhs, Kind rhs) {
+    return static_cast<unsigned>(lhs) << 8u | static_cast<unsigned>(rhs);
+}
+
+class Object {
+ public:
+    explicit Object(Kind kind = Kind::Other) : kind(kind) {
+    }
+
+    // A copy is a new object, nobody references it yet
+    Object(const Object &other) : kind(other.kind) {
+    }
+
+    Object &operator=(const Object &) {
+        return *this;
+    }
+
+    virtual ~Object() = default;
+
+    virtual void Print(std::ostream &os) = 0;
+
+    Kind GetKind() const {
+        return kind;
+    }
+
+ private:
+    friend class ObjectHolder;
+
+    uint32_t ref_count = 0;
+    Kind kind;
+};
+
+template<typename T>
+constexpr Kind KindOf = Kind::Other;
+
+template<>
+constexpr Kind KindOf<int> = Kind::Number;
+
+template<>
+constexpr Kind KindOf<std::string> = Kind::String;
+
+template<typename T>
+class ValueObject : public Object {
+ public:
+    static constexpr Kind kKind = KindOf<T>;
+
+    ValueObject(T v, Kind kind = kKind) : Object(kind), value(v) {
+    }
+
+    void Print(std::ostream &os) override {
+        os << value;
+    }
+
+    const T &GetValue() const {
+        return value;
+    }
+
+ private:
+    T value;
+};
+
+using String = ValueObject<std::string>;
+using Number = ValueObject<int>;
+
+class Bool : public ValueObject<bool> {
+ public:
+    static constexpr Kind kKind = Kind::Bool;
+
+    Bool(bool v) : ValueObject<bool>(v, kKind) {
+    }
+
+    void Print(std::ostream &os) override;
+};
+
+} /* namespace Runtime */
@@ -0,0 +1,529 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+
+using namespace std;
+
+// Computed goto jumps from every instruction straight to the next handler,
+// instead of going back to one shared switch
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(SITHON_NO_COMPUTED_GOTO)
+#define SITHON_COMPUTED_GOTO
+#endif
+
+namespace Bytecode {
+
+namespace {
+
+using Runtime::ClassInstance;
+using Runtime::Kind;
+using Runtime::KindPair;
+
+ObjectHolder CallMethod(const Runtime::Method &method, ClassInstance &self, const ObjectHolder *args, size_t argument_count) {
+    if (method.code) {
+        return Invoke(*method.code, self, args, argument_count);
+    } else {
+        return self.Invoke(method, vector<ObjectHolder>(args, args + argument_count));
+    }
+}
+
+bool BothNumbers(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    return KindPair(lhs.GetKind(), rhs.GetKind()) == KindPair(Kind::Number, Kind::Number);
+}
+
+int NumberValue(const ObjectHolder &value) {
+    return value.TryAs<Runtime::Number>()->GetValue();
+}
+
+template<Runtime::CompareOp op>
+ObjectHolder CompareRegisters(const ObjectHolder &lhs, const ObjectHolder &rhs) {
+    if (BothNumbers(lhs, rhs)) {
+        return ObjectHolder::Own(Runtime::Bool(Runtime::CompareValues<op>(NumberValue(lhs), NumberValue(rhs))));
+    } else {
+        return ObjectHolder::Own(Runtime::Bool(Runtime::Compare<op>(lhs, rhs)));
+    }
+}
+
+// Method the VM is running without native recursion, and the state its caller resumes from
+struct Activation {
+    Runtime::Frame frame;
+    size_t bytes;
+    Function *caller;
+    const Instruction *resume;
+    uint32_t result;
+    // Instance created by New: the value of the call instead of what __init__ returns
+    ObjectHolder constructed;
+};
+
+// Part of the native stack nested Executes may take. The rest is left to what runs below the
+// first Execute and to the runtime calls made from the innermost one.
+size_t NativeStackLimit() {
+    static const size_t limit = [] {
+        rlimit native{};
+        if (getrlimit(RLIMIT_STACK, &native) == 0 && native.rlim_cur != RLIM_INFINITY) {
+            return static_cast<size_t>(native.rlim_cur) / 2;
+        }
+        return size_t(4) << 20;
+    }();
+    return limit;
+}
+
+// Activations of all running Executes. Nested Executes (e.g. for __str__ called while printing)
+// continue on the same stack, so activations must stay where they are while it grows: an outer
+// Execute keeps a pointer to the frame of its top activation.
+class CallStack {
+ public:
+    size_t Depth() const {
+        return activations.size();
+    }
+
+    bool Running() const {
+        return executes > 0;
+    }
+
+    Activation &Top() {
+        return activations.back();
+    }
+
+    void Push(Function &callee, Function *caller, const Instruction *resume, uint32_t result) {
+        auto bytes = FrameBytes(callee.register_count);
+        Reserve(bytes);
+        activations.push_back({Runtime::Frame(callee.register_count), bytes, caller, resume, result, {}});
+    }
+
+    void Pop() {
+        used -= activations.back().bytes;
+        activations.pop_back();
+    }
+
+    void GrowTop(size_t register_count) {
+        auto &top = Top();
+        auto bytes = FrameBytes(register_count);
+        Reserve(bytes - top.bytes);
+        top.frame.Grow(register_count);
+        top.bytes = bytes;
+    }
+
+    void SetLimit(size_t bytes) {
+        limit = bytes;
+    }
+
+    // Nested Executes are called by the runtime and recurse natively. The native stack they
+    // take, measured from the first Execute, counts against the limit along with the frames.
+    // Returns what was taken before, for LeaveExecute.
+    size_t EnterExecute(const void *native_frame) {
+        auto address = reinterpret_cast<uintptr_t>(native_frame);
+        auto previous = native_used;
+        if (executes++ == 0) {
+            native_base = address;
+        } else {
+            native_used = native_base > address ? native_base - address : address - native_base;
+        }
+        if (native_used > NativeStackLimit() || used + native_used > limit) {
+            LeaveExecute(previous);
+            throw runtime_error("Stack limit exceeded: too deep recursion");
+        }
+        return previous;
+    }
+
+    void LeaveExecute(size_t previous_native_used) {
+        --executes;
+        native_used = previous_native_used;
+    }
+
+ private:
+    static size_t FrameBytes(size_t register_count) {
+        return sizeof(Activation) + register_count * sizeof(ObjectHolder);
+    }
+
+    void Reserve(size_t bytes) {
+        if (used + native_used + bytes > limit) {
+            throw runtime_error("Stack limit exceeded: too deep recursion");
+        }
+        used += bytes;
+    }
+
+    deque<Activation> activations;
+    size_t used = 0;
+    size_t limit = kDefaultStackLimit;
+    size_t executes = 0;
+    uintptr_t native_base = 0;
+    size_t native_used = 0;
+};
+
+CallStack &GetCallStack() {
+    static CallStack stack;
+    return stack;
+}
+
+// Enters an Execute and pops the activations it has pushed, also when it's left by an exception
+class CallStackGuard {
+ public:
+    explicit CallStackGuard(CallStack &stack)
+        : stack(stack), base(stack.Depth()), native_used(stack.EnterExecute(this)) {
+    }
+
+    ~CallStackGuard() {
+        while (stack.Depth() > base) {
+            stack.Pop();
+        }
+        stack.LeaveExecute(native_used);
+    }
+
+    size_t Base() const {
+        return base;
+    }
+
+ private:
+    CallStack &stack;
+    size_t base;
+    size_t native_used;
+};
+
+// Runs a function and every bytecode method it calls in one loop. A call pushes an activation
+// with a new frame and a return pops it, so the native stack doesn't grow with Sithon calls.
+ObjectHolder Execute(Function &entry, Runtime::Frame &entry_frame) {
+    auto &stack = GetCallStack();
+    CallStackGuard guard(stack);
+    const size_t base = guard.Base();
+
+    Function *function = &entry;
+    Runtime::Frame *frame = &entry_frame;
+    ObjectHolder *r = frame->Slots();
+    const Instruction *code = function->code.data();
+    const Instruction *ip = code;
+    ObjectHolder returned;
+
+    // Enters a bytecode method: self and the arguments go to the first registers of its new frame
+    auto enter = [&](Function &callee, ObjectHolder self, const ObjectHolder *args, size_t argument_count, uint32_t result) {
+        stack.Push(callee, function, ip + 1, result);
+        frame = &stack.Top().frame;
+        auto *registers = frame->Slots();
+        registers[0] = std::move(self);
+        copy(args, args + argument_count, registers + 1);
+        function = &callee;
+        r = registers;
+        code = function->code.data();
+        ip = code;
+    };
+
+#ifdef SITHON_COMPUTED_GOTO
+    static const void *const handlers[] = {
+#define SITHON_OPCODE_LABEL(name) &&Op##name,
+        SITHON_OPCODES(SITHON_OPCODE_LABEL)
+#undef SITHON_OPCODE_LABEL
+    };
+#define DISPATCH() goto *handlers[static_cast<size_t>(ip->op)]
+#define OP(name) Op##name
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define OP(name) case OpCode::name
+dispatch:
+    switch (ip->op) {
+#endif
+#define NEXT() do { ++ip; DISPATCH(); } while (false)
+
+    OP(LoadConst):
+        r[ip->a] = function->constants[ip->b];
+        NEXT();
+
+    OP(LoadNone):
+        r[ip->a] = ObjectHolder::None();
+        NEXT();
+
+    OP(LoadBool):
+        r[ip->a] = ObjectHolder::Own(Runtime::Bool(ip->b != 0));
+        NEXT();
+
+    OP(Move):
+        r[ip->a] = r[ip->b];
+        NEXT();
+
+    OP(CheckSet):
+        if (Runtime::Frame::IsUnset(r[ip->a])) {
+            throw Ast::NameNotFound(function->names[ip->b], ip->c != 0);
+        }
+        NEXT();
+
+    OP(GetField): {
+        auto &site = function->field_sites[ip->c];
+        auto *instance = r[ip->b].TryAs<ClassInstance>();
+        if (!instance) {
+            throw runtime_error(site.object_name.Name() + " is not an object, can't access its fields");
+        }
+        auto *field = instance->FindField(site.field, site.cache);
+        if (!field) {
+            throw Ast::NameNotFound(site.field, site.last);
+        }
+        // Copy first: the destination may hold the only reference to the instance
+        ObjectHolder value = *field;
+        r[ip->a] = std::move(value);
+        NEXT();
+    }
+
+    OP(CheckInstance):
+        if (!r[ip->a].TryAs<ClassInstance>()) {
+            throw runtime_error(
+                "Cannot assign to the field " + function->field_sites[ip->b].field.Name() + " of not an object"
+            );
+        }
+        NEXT();
+
+    OP(SetField): {
+        auto &site = function->field_sites[ip->c];
+        r[ip->a].TryAs<ClassInstance>()->SetField(site.field, r[ip->b], site.cache);
+        NEXT();
+    }
+
+    OP(Add):
+        if (BothNumbers(r[ip->b], r[ip->c])) {
+            r[ip->a] = ObjectHolder::Own(Runtime::Number(NumberValue(r[ip->b]) + NumberValue(r[ip->c])));
+        } else {
+            r[ip->a] = Ast::Add::Evaluate(r[ip->b], r[ip->c]);
+        }
+        NEXT();
+
+    OP(Sub):
+        if (BothNumbers(r[ip->b], r[ip->c])) {
+            r[ip->a] = ObjectHolder::Own(Runtime::Number(NumberValue(r[ip->b]) - NumberValue(r[ip->c])));
+        } else {
+            r[ip->a] = Ast::Sub::Evaluate(r[ip->b], r[ip->c]);
+        }
+        NEXT();
+
+    OP(Mult):
+        if (BothNumbers(r[ip->b], r[ip->c])) {
+            r[ip->a] = ObjectHolder::Own(Runtime::Number(NumberValue(r[ip->b]) * NumberValue(r[ip->c])));
+        } else {
+            r[ip->a] = Ast::Mult::Evaluate(r[ip->b], r[ip->c]);
+        }
+        NEXT();
+
+    OP(Div):
+        if (BothNumbers(r[ip->b], r[ip->c]) && NumberValue(r[ip->c]) != 0) {
+            r[ip->a] = ObjectHolder::Own(Runtime::Number(NumberValue(r[ip->b]) / NumberValue(r[ip->c])));
+        } else {
+            r[ip->a] = Ast::Div::Evaluate(r[ip->b], r[ip->c]);
+        }
+        NEXT();
+
+    OP(Less):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::Less>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(Greater):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::Greater>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(Equal):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::Equal>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(NotEqual):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::NotEqual>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(LessOrEqual):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::LessOrEqual>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(GreaterOrEqual):
+        r[ip->a] = CompareRegisters<Runtime::CompareOp::GreaterOrEqual>(r[ip->b], r[ip->c]);
+        NEXT();
+
+    OP(Not):
+        r[ip->a] = ObjectHolder::Own(Runtime::Bool(!IsTrue(r[ip->b])));
+        NEXT();
+
+    OP(Negate):
+        if (r[ip->b].GetKind() == Kind::Number) {
+            r[ip->a] = ObjectHolder::Own(Runtime::Number(-NumberValue(r[ip->b])));
+        } else {
+            r[ip->a] = Ast::Negate::Evaluate(r[ip->b]);
+        }
+        NEXT();
+
+    OP(Str):
+        r[ip->a] = Ast::Stringify::Evaluate(r[ip->b]);
+        NEXT();
+
+    OP(Call): {
+        auto &site = function->call_sites[ip->c];
+        auto *instance = r[ip->b].TryAs<ClassInstance>();
+        if (!instance) {
+            throw runtime_error(
+                "Trying to call method " + site.method.Name() + " on object whicj is not a class instance"
+            );
+        }
+        const auto &method = site.cache.Lookup(instance->GetClass(), site.method, site.argument_count);
+        if (method.code) {
+            // The destination may be one of the arguments, so it is assigned only on return
+            enter(*method.code, r[ip->b], r + site.args, site.argument_count, ip->a);
+            DISPATCH();
+        }
+        ObjectHolder result = CallMethod(method, *instance, r + site.args, site.argument_count);
+        r[ip->a] = std::move(result);
+        NEXT();
+    }
+
+    OP(TailCall): {
+        auto &site = function->call_sites[ip->b];
+        auto *instance = r[ip->a].TryAs<ClassInstance>();
+        if (!instance) {
+            throw runtime_error(
+                "Trying to call method " + site.method.Name() + " on object whicj is not a class instance"
+            );
+        }
+        const auto &method = site.cache.Lookup(instance->GetClass(), site.method, site.argument_count);
+        if (!method.code) {
+            returned = CallMethod(method, *instance, r + site.args, site.argument_count);
+            goto leave;
+        }
+
+        // The callee takes over the frame: self and the arguments go to its first registers,
+        // and the rest are unset like in a new frame
+        ObjectHolder self = r[ip->a];
+        auto argument_count = site.argument_count;
+        auto args = site.args;
+        function = method.code.get();
+        if (function->register_count > frame->Size()) {
+            if (stack.Depth() > base) {
+                stack.GrowTop(function->register_count);
+            } else {
+                frame->Grow(function->register_count);
+            }
+            r = frame->Slots();
+        }
+        if (args != 1) {
+            for (uint32_t i = 0; i < argument_count; ++i) {
+                r[i + 1] = std::move(r[args + i]);
+            }
+        }
+        r[0] = std::move(self);
+        frame->Clear(argument_count + 1);
+
+        code = function->code.data();
+        ip = code;
+        DISPATCH();
+    }
+
+    OP(New): {
+        auto &site = function->new_sites[ip->b];
+        auto instance = ObjectHolder::Own(ClassInstance(*site.cls));
+        if (auto *m = site.cls->GetMethod(Runtime::SpecialMethod::Slot::Init)) {
+            const auto &init = site.cls->ResolveMethod(*m, site.argument_count);
+            if (init.code) {
+                enter(*init.code, instance, r + site.args, site.argument_count, ip->a);
+                stack.Top().constructed = std::move(instance);
+                DISPATCH();
+            }
+            CallMethod(init, *instance.TryAs<ClassInstance>(), r + site.args, site.argument_count);
+        }
+        r[ip->a] = std::move(instance);
+        NEXT();
+    }
+
+    OP(PrintSpace):
+        Ast::Print::GetOutputStream() << ' ';
+        NEXT();
+
+    OP(Print): {
+        auto &output = Ast::Print::GetOutputStream();
+        if (r[ip->a]) {
+            r[ip->a]->Print(output);
+        } else {
+            output << "None";
+        }
+        NEXT();
+    }
+
+    OP(PrintNewline):
+        Ast::Print::GetOutputStream() << '\n';
+        NEXT();
+
+    OP(Jump):
+        ip = code + ip->a;
+        DISPATCH();
+
+    OP(JumpIfFalse):
+        if (!IsTrue(r[ip->a])) {
+            ip = code + ip->b;
+            DISPATCH();
+        }
+        NEXT();
+
+    OP(JumpIfTrue):
+        if (IsTrue(r[ip->a])) {
+            ip = code + ip->b;
+            DISPATCH();
+        }
+        NEXT();
+
+    OP(Return):
+        returned = r[ip->a];
+        goto leave;
+
+    OP(ReturnNone):
+        returned = ObjectHolder::None();
+        goto leave;
+
+#ifndef SITHON_COMPUTED_GOTO
+    }
+    throw logic_error("Unknown opcode");
+#endif
+
+leave:
+    if (stack.Depth() == base) {
+        return returned;
+    } else {
+        auto &top = stack.Top();
+        function = top.caller;
+        ip = top.resume;
+        auto result = top.result;
+        if (top.constructed) {
+            returned = std::move(top.constructed);
+        }
+        stack.Pop();
+
+        frame = stack.Depth() > base ? &stack.Top().frame : &entry_frame;
+        r = frame->Slots();
+        code = function->code.data();
+        r[result] = std::move(returned);
+        DISPATCH();
+    }
+#undef NEXT
+#undef OP
+#undef DISPATCH
+}
+
+}
+
+void Run(Function &program) {
+    Runtime::Frame frame(program.register_count);
+    Execute(program, frame);
+}
+
+void SetStackLimit(size_t bytes) {
+    GetCallStack().SetLimit(bytes);
+}
+
+bool IsRunning() {
+    return GetCallStack().Running();
+}
+
+ObjectHolder Invoke(Function &method, ClassInstance &self, const ObjectHolder *args, size_t argument_count) {
+    Runtime::Frame frame(method.register_count);
+    auto *registers = frame.Slots();
+    registers[0] = ObjectHolder::Share(self);
+    copy(args, args + argument_count, registers + 1);
+    return Execute(method, frame);
+}
+
+}